@@ -0,0 +1,42 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sc.h>
+
+int main(int argc, char *argv[])
+{
+  session *s;
+
+  if (argc < 2) return EXIT_FAILURE;
+  char *protocol = argv[argc-1]; // Local protocol is the last argument.
+  session_init(&argc, &argv, &s, protocol);
+
+  int N = (argc > 2) ? atoi(argv[1]) : 1000; // Number of barriers
+  role *grp = s->r(s, "_Others");
+  int i;
+
+  barrier(grp, "R0"); // Warm up (all roles connected).
+
+  long long barrier_start = sc_time();
+  for (i=0; i<N; i++) {
+    barrier(grp, "R0");
+  }
+  long long barrier_end_time = sc_time();
+
+  // Split-phase barrier, with nothing to overlap.
+  long long split_start = sc_time();
+  for (i=0; i<N; i++) {
+    barrier_begin(grp, "R0");
+    barrier_end(grp, "R0");
+  }
+  long long split_end = sc_time();
+
+  printf("%s: %d roles, barrier: %f usec, split-phase barrier: %f usec\n",
+      s->name, group_size(grp),
+      sc_time_diff(barrier_start, barrier_end_time) * 1000000 / N,
+      sc_time_diff(split_start, split_end) * 1000000 / N);
+
+  session_end(s);
+
+  return EXIT_SUCCESS;
+}
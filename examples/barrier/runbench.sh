@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+# Barrier benchmark: sweep number of roles and barrier algorithms.
+# Usage: ./runbench.sh [number of barriers] [role counts...]
+#
+
+N=${1:-1000}
+shift
+COUNTS=${*:-"2 4 8 16"}
+DIR=bench.tmp
+
+mkdir -p $DIR
+
+for n in $COUNTS; do
+
+  # Protocol and connection configuration for n roles.
+  roles=""
+  i=0
+  while [ $i -lt $n ]; do roles="$roles R$i"; i=$((i+1)); done
+
+  echo "global protocol Bench($(echo $roles | sed 's/\(R[0-9]*\)/role \1/g; s/ role/, role/g')) {" > $DIR/Bench.spr
+  echo "}" >> $DIR/Bench.spr
+  for r in $roles; do
+    others=$(echo $roles | tr ' ' '\n' | grep -vx $r | sed 's/^/role /' | paste -sd, - | sed 's/,/, /g')
+    printf "local protocol Bench at %s(%s) {\n}\n" $r "$others" > $DIR/Bench_$r.spr
+  done
+
+  port=9000
+  nconn=$((n*(n-1)/2 + n))
+  echo "$n $nconn" > $DIR/connection.conf
+  for r in $roles; do echo "$r localhost" >> $DIR/connection.conf; done
+  for r in $roles; do
+    for r2 in $roles; do
+      if [ ${r#R} -lt ${r2#R} ]; then
+        echo "1 $r $r2 ipc:localhost $port" >> $DIR/connection.conf
+        port=$((port+1))
+      fi
+    done
+  done
+  for r in $roles; do
+    echo "2 $r $r localhost $port" >> $DIR/connection.conf
+    port=$((port+1))
+  done
+
+  for alg in central dissemination tournament; do
+    echo "== $n roles, $alg barrier =="
+    for r in $roles; do
+      ./bench -c $DIR/connection.conf --barrier $alg $N $DIR/Bench_$r.spr 2>/dev/null | grep "^R0:" &
+    done
+    wait
+  done
+
+done
+
+rm -r $DIR
@@ -6,7 +6,11 @@
  * toplevel wrapper header.
  */
 
+#include <sc/collectives.h>
+#include <sc/datatype.h>
+#include <sc/pool.h>
 #include <sc/primitives.h>
+#include <sc/request.h>
 #include <sc/session.h>
 #include <sc/types.h>
 #include <sc/utils.h>
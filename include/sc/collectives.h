@@ -0,0 +1,267 @@
+#ifndef SC__COLLECTIVES_H__
+#define SC__COLLECTIVES_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * collective communication module.
+ *
+ * Collectives run over the members of a group role (eg. _Others)
+ * and the local role. Members are ranked by role name, rank order
+ * is the order of chunks in the (root) arrays of a collective.
+ */
+
+#include <stddef.h>
+
+#include "sc/types.h"
+
+// Reduction operations.
+#define SC_OP_SUM  0
+#define SC_OP_PROD 1
+#define SC_OP_MIN  2
+#define SC_OP_MAX  3
+#define SC_OP_BAND 4
+#define SC_OP_BOR  5
+#define SC_OP_BXOR 6
+
+
+/**
+ * \brief Number of members in a collective on a group role.
+ *
+ * @param[in] grp_role Group role
+ *
+ * \returns Number of members (including the local role).
+ */
+int group_size(role *grp_role);
+
+
+/**
+ * \brief Rank of a role in a collective on a group role.
+ *
+ * @param[in] grp_role Group role
+ * @param[in] rolename Role name (string)
+ *
+ * \returns Rank of role, or -1 if role is not a member.
+ */
+int group_rank(role *grp_role, const char *rolename);
+
+
+/**
+ * \brief Scatter an integer array from a root role.
+ *
+ * @param[in]  sendarr     Array to scatter, count elements for each
+ *                         member in rank order (significant at root only)
+ * @param[out] recvarr     Array to receive count elements
+ * @param[in]  count       Number of elements received by each member
+ * @param[in]  grp_role    Group role to scatter to
+ * @param[in]  at_rolename Role name (string) of the root
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int scatter_int_array(const int sendarr[], int recvarr[], size_t count, role *grp_role, char *at_rolename);
+
+
+/**
+ * \brief Gather an integer array at a root role.
+ *
+ * The root receives the chunks in order of arrival.
+ *
+ * @param[in]  sendarr     Array of count elements to send
+ * @param[out] recvarr     Array to receive count elements from each
+ *                         member in rank order (significant at root only)
+ * @param[in]  count       Number of elements sent by each member
+ * @param[in]  grp_role    Group role to gather from
+ * @param[in]  at_rolename Role name (string) of the root
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int gather_int_array(const int sendarr[], int recvarr[], size_t count, role *grp_role, char *at_rolename);
+
+
+/**
+ * \brief Gather an integer array at every member.
+ *
+ * Chunks are received in order of arrival.
+ *
+ * @param[in]  sendarr  Array of count elements to send
+ * @param[out] recvarr  Array to receive count elements from
+ *                      each member in rank order
+ * @param[in]  count    Number of elements sent by each member
+ * @param[in]  grp_role Group role to gather from
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int allgather_int_array(const int sendarr[], int recvarr[], size_t count, role *grp_role);
+
+
+/**
+ * \brief Reduce integer arrays element-wise at a root role.
+ *
+ * @param[in]  sendarr     Array of count elements to reduce
+ * @param[out] recvarr     Array to receive the result
+ *                         (significant at root only)
+ * @param[in]  count       Number of elements
+ * @param[in]  op          Reduction operation (SC_OP_*)
+ * @param[in]  grp_role    Group role to reduce over
+ * @param[in]  at_rolename Role name (string) of the root
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int reduce_int_array(const int sendarr[], int recvarr[], size_t count, int op, role *grp_role, char *at_rolename);
+
+
+/**
+ * \brief Reduce integer arrays element-wise at every member.
+ *
+ * @param[in]  sendarr  Array of count elements to reduce
+ * @param[out] recvarr  Array to receive the result
+ * @param[in]  count    Number of elements
+ * @param[in]  op       Reduction operation (SC_OP_*)
+ * @param[in]  grp_role Group role to reduce over
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int allreduce_int_array(const int sendarr[], int recvarr[], size_t count, int op, role *grp_role);
+
+
+/**
+ * \brief Inclusive prefix reduction of integer arrays.
+ *
+ * The member of rank i receives the reduction
+ * of the arrays of ranks 0 to i.
+ *
+ * @param[in]  sendarr  Array of count elements to reduce
+ * @param[out] recvarr  Array to receive the result
+ * @param[in]  count    Number of elements
+ * @param[in]  op       Reduction operation (SC_OP_*)
+ * @param[in]  grp_role Group role to reduce over
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int scan_int_array(const int sendarr[], int recvarr[], size_t count, int op, role *grp_role);
+
+
+
+/**
+ * \brief All-to-all personalised exchange of integer arrays.
+ *
+ * Every member sends a distinct block of count elements to every
+ * member. Pairwise schedule: in each step every member exchanges
+ * with exactly one partner.
+ *
+ * @param[in]  sendarr  Array of count elements for each member in rank order
+ * @param[out] recvarr  Array to receive count elements from each member in rank order
+ * @param[in]  count    Number of elements per block
+ * @param[in]  grp_role Group role to exchange with
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int alltoall_int_array(const int sendarr[], int recvarr[], size_t count, role *grp_role);
+
+
+/**
+ * \brief All-to-all personalised exchange of variable sized blocks.
+ *
+ * @param[in]  sendarr    Array to send from
+ * @param[in]  sendcounts Number of elements to send to each member (rank order)
+ * @param[in]  sdispls    Offset in sendarr of the block for each member
+ * @param[out] recvarr    Array to receive into
+ * @param[in]  recvcounts Number of elements to receive from each member
+ * @param[in]  rdispls    Offset in recvarr of the block from each member
+ * @param[in]  grp_role   Group role to exchange with
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int alltoallv_int_array(const int sendarr[], const size_t sendcounts[], const size_t sdispls[],
+                        int recvarr[], const size_t recvcounts[], const size_t rdispls[],
+                        role *grp_role);
+
+
+/**
+ * \brief Exchange integer arrays with neighbouring roles (halo exchange).
+ *
+ * Block i of sendarr is sent to neighbours[i], block i of recvarr is
+ * received from neighbours[i]. All blocks are sent before any is
+ * received, received blocks are taken in order of arrival.
+ * The neighbours of the local protocol are given by session_neighbours().
+ *
+ * @param[in]  sendarr     Array of count elements for each neighbour
+ * @param[out] recvarr     Array to receive count elements from each neighbour
+ * @param[in]  count       Number of elements per block
+ * @param[in]  neighbours  Neighbour roles
+ * @param[in]  nneighbour  Number of neighbours
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int neighbour_exchange_int_array(const int sendarr[], int recvarr[], size_t count,
+                                 role *neighbours[], int nneighbour);
+
+
+/**
+ * \brief Broadcast an integer array from a root role.
+ *
+ * Unlike bcast_int_array (fan-out over the group PUB socket) members
+ * relay the array, the root does not send a copy per member: binomial
+ * tree for small arrays (log2 n copies from the root), scatter then
+ * ring allgather for large arrays (every rank, the root too, sends
+ * about 2(n-1)/n of the array), a pipelined chain of segments for
+ * very large arrays (one copy from the root).
+ * Members sharing a host are reached through one leader per host.
+ *
+ * @param[in,out] arr         Array to broadcast (at root), to receive into (others)
+ * @param[in]     count       Number of elements
+ * @param[in]     grp_role    Group role to broadcast to
+ * @param[in]     at_rolename Role name (string) of the root
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int bcast_int_array_at(int arr[], size_t count, role *grp_role, char *at_rolename);
+
+
+/**
+ * \brief Barrier synchronisation.
+ *
+ * The algorithm is selected per session (--barrier): central
+ * (coordinated by at_rolename over the group PUB/SUB sockets,
+ * or the point-to-point endpoints of a session_group() sub-group),
+ * dissemination or tournament (point-to-point, log2(n) rounds).
+ * The point-to-point barriers synchronise members sharing a host
+ * through their host leader, only leaders synchronise across hosts.
+ *
+ * @param[in] grp_role    Group role to perform barrier synchronisation on
+ * @param[in] at_rolename Role name (string) to act as central coordinator
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int barrier(role *grp_role, char *at_rolename);
+
+
+/**
+ * \brief Start a split-phase barrier.
+ *
+ * Signals arrival without waiting, work can be overlapped with the
+ * synchronisation until barrier_end(). No messages to the group may
+ * be sent or received in between.
+ *
+ * @param[in] grp_role    Group role to perform barrier synchronisation on
+ * @param[in] at_rolename Role name (string) to act as central coordinator
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int barrier_begin(role *grp_role, char *at_rolename);
+
+
+/**
+ * \brief Complete a split-phase barrier.
+ *
+ * Returns once every member of the group has called barrier_begin().
+ *
+ * @param[in] grp_role    Group role to perform barrier synchronisation on
+ * @param[in] at_rolename Role name (string) to act as central coordinator
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int barrier_end(role *grp_role, char *at_rolename);
+
+
+#endif // SC__COLLECTIVES_H__
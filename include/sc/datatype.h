@@ -0,0 +1,89 @@
+#ifndef SC__DATATYPE_H__
+#define SC__DATATYPE_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * derived datatype module.
+ *
+ * A datatype describes which integers of an array make up
+ * a message, eg. a matrix column or a sub-block, so they can
+ * be sent and received with send_int_typed/recv_int_typed
+ * without hand-written packing loops. Contiguous layouts are
+ * sent directly.
+ */
+
+#include <stddef.h>
+
+#include "sc/types.h"
+
+
+/**
+ * \brief Create a strided vector datatype.
+ *
+ * @param[in]  count    Number of blocks
+ * @param[in]  blocklen Number of elements in each block
+ * @param[in]  stride   Number of elements between start of each block
+ * @param[out] type     Datatype
+ *
+ * \returns 0 if successful, -1 otherwise.
+ */
+int datatype_vector(size_t count, size_t blocklen, size_t stride, datatype **type);
+
+
+/**
+ * \brief Create an indexed datatype.
+ *
+ * @param[in]  count     Number of blocks
+ * @param[in]  blocklens Number of elements in each block
+ * @param[in]  displs    Displacement (in elements) of each block
+ * @param[out] type      Datatype
+ *
+ * \returns 0 if successful, -1 otherwise.
+ */
+int datatype_indexed(size_t count, const size_t blocklens[], const size_t displs[], datatype **type);
+
+
+/**
+ * \brief Create a subarray datatype (row-major order).
+ *
+ * @param[in]  ndims    Number of dimensions
+ * @param[in]  sizes    Size of array in each dimension
+ * @param[in]  subsizes Size of subarray in each dimension
+ * @param[in]  starts   Start of subarray in each dimension
+ * @param[out] type     Datatype
+ *
+ * \returns 0 if successful, -1 otherwise.
+ */
+int datatype_subarray(int ndims, const size_t sizes[], const size_t subsizes[],
+                      const size_t starts[], datatype **type);
+
+
+/**
+ * \brief Free a datatype.
+ *
+ * @param[in,out] type Datatype to free (set to null)
+ */
+void datatype_free(datatype **type);
+
+
+/**
+ * \brief Pack the elements of a datatype into a contiguous buffer.
+ *
+ * @param[in]  arr  Array described by datatype
+ * @param[in]  type Datatype
+ * @param[out] buf  Buffer (at least type->size elements)
+ */
+void datatype_pack(const int *arr, const datatype *type, int *buf);
+
+
+/**
+ * \brief Unpack a contiguous buffer into the elements of a datatype.
+ *
+ * @param[in]  buf  Buffer (at least type->size elements)
+ * @param[in]  type Datatype
+ * @param[out] arr  Array described by datatype
+ */
+void datatype_unpack(const int *buf, const datatype *type, int *arr);
+
+
+#endif // SC__DATATYPE_H__
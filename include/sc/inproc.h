@@ -0,0 +1,31 @@
+#ifndef SC__INPROC_H__
+#define SC__INPROC_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * in-process channel transport module.
+ *
+ * Roles running as threads of one process (`inproc:name' in the
+ * hosts file, every role on the same inproc:name host shares the
+ * process) are connected with in-memory channels instead of sockets.
+ * A channel holds a bounded single-producer/single-consumer queue of
+ * messages per direction; sent messages are moved into the queue and
+ * out to the receiver without copying the payload. Messages that do
+ * not fit are queued on the sending end and moved in while the role
+ * waits (receive, poll, send_flush) or closes, a send never waits.
+ *
+ * Each role thread calls session_init with its own protocol and
+ * argument vector, the two ends of a channel meet by name and port
+ * whichever thread connects first.
+ */
+
+#include "sc/types.h"
+
+
+/**
+ * The in-process channel transport (registered as "inproc").
+ */
+extern const transport transport_inproc;
+
+
+#endif // SC__INPROC_H__
@@ -0,0 +1,86 @@
+#ifndef SC__POOL_H__
+#define SC__POOL_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * message buffer pool module.
+ *
+ * Buffers are taken from power-of-two size classes, carved out
+ * of large slabs and recycled through a per-thread cache backed
+ * by a shared depot, so a steady-state send/receive loop does not
+ * call the system allocator. Buffers over 1MB are mapped one at a
+ * time, a few of each class are kept in the depot for reuse.
+ * Build with -DSC_POOL_HUGEPAGE to back slabs with huge pages
+ * where available.
+ */
+
+#include <stddef.h>
+
+#include "sc/types.h"
+
+
+/**
+ * \brief Allocate a buffer from the pool.
+ *
+ * Requests larger than the largest size class (64GB)
+ * are passed on to malloc.
+ *
+ * @param[in] size Size of buffer (in bytes)
+ *
+ * \returns Pointer to buffer, or NULL on failure.
+ */
+void *sc_pool_alloc(size_t size);
+
+
+/**
+ * \brief Resize a buffer allocated from the pool.
+ *
+ * @param[in] ptr  Buffer to resize (can be null)
+ * @param[in] size New size of buffer (in bytes)
+ *
+ * \returns Pointer to resized buffer, or NULL on failure.
+ */
+void *sc_pool_realloc(void *ptr, size_t size);
+
+
+/**
+ * \brief Return a buffer to the pool.
+ *
+ * Safe to call from any thread.
+ *
+ * @param[in] ptr Buffer to release (can be null)
+ */
+void sc_pool_free(void *ptr);
+
+
+/**
+ * \brief Return a buffer to the pool (ZeroMQ free function).
+ *
+ * @param[in] data Buffer to release
+ * @param[in] hint Unused
+ */
+void sc_pool_free_fn(void *data, void *hint);
+
+
+/**
+ * \brief Usable size of a buffer allocated from the pool.
+ *
+ * @param[in] ptr Buffer
+ *
+ * \returns Size of buffer (in bytes).
+ */
+size_t sc_pool_size(const void *ptr);
+
+
+/**
+ * \brief Get pool statistics.
+ *
+ * Counts calls the pool made to the system allocator,
+ * these stay constant in a steady-state loop.
+ *
+ * @param[out] stat Pool statistics
+ */
+void sc_pool_stats(pool_stat *stat);
+
+
+#endif // SC__POOL_H__
@@ -37,6 +37,127 @@ int send_int(int val, role *r, const char *label);
 int send_int_array(const int arr[], size_t count, role *r, const char *label);
 
 
+/**
+ * \brief Send an integer array without copying (ownership transfer).
+ *
+ * The runtime takes ownership of arr and calls ffn(arr, hint) once
+ * the message is no longer needed, so the caller must not modify or
+ * free arr after this call (use ffn to recycle the buffer instead).
+ *
+ * @param[in] arr   Array to send (ownership transferred)
+ * @param[in] count Number of elements in array
+ * @param[in] r     Role to send to
+ * @param[in] label Message label (can be null)
+ * @param[in] ffn   Deallocation function for arr (free() if null)
+ * @param[in] hint  Extra argument passed to ffn
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int send_int_array_nocopy(int *arr, size_t count, role *r, const char *label,
+                          sc_free_fn *ffn, void *hint);
+
+
+/**
+ * \brief Send multiple integer arrays as one message (gather).
+ *
+ * The segments are gathered straight into a single message,
+ * the receiver sees their concatenation.
+ *
+ * @param[in] iov    Segments to send
+ * @param[in] iovcnt Number of segments
+ * @param[in] r      Role to send to
+ * @param[in] label  Message label (can be null)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int send_int_iov(const msg_iov iov[], int iovcnt, role *r, const char *label);
+
+
+/**
+ * \brief Send multiple integer arrays as one message,
+ * labelled with a precomputed label key.
+ *
+ * @param[in] iov    Segments to send
+ * @param[in] iovcnt Number of segments
+ * @param[in] r      Role to send to
+ * @param[in] key    Label key, see sc_label_hash() (can be null)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int send_int_iov_key(const msg_iov iov[], int iovcnt, role *r, const unsigned int *key);
+
+
+/**
+ * \brief Send out all coalesced messages held back.
+ *
+ * In coalescing mode (--coalesce) sends to roles the local protocol
+ * sends runs of messages to are held back and sent as one batch,
+ * when the role next blocks to receive or wait, when the batch
+ * is large or at session_end(). Both ends must use the mode.
+ * Data held back by transports (corked TCP sockets) is pushed
+ * out as well.
+ *
+ * @param[in] s Session
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int send_flush(session *s);
+
+
+/**
+ * \brief Send a synchronisation token (of a barrier).
+ *
+ * Tokens are control frames, never taken for messages: a receive
+ * from the role skips tokens, which are left to recv_token().
+ *
+ * @param[in] r Point-to-point role to send to
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int send_token(role *r);
+
+
+/**
+ * \brief Send the integers of an array described by a datatype.
+ *
+ * Contiguous layouts are sent directly, others are packed
+ * into the message (see sc/datatype.h).
+ *
+ * @param[in] arr   Array to send from
+ * @param[in] type  Datatype describing the elements to send
+ * @param[in] r     Role to send to
+ * @param[in] label Message label (can be null)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int send_int_typed(const int *arr, const datatype *type, role *r, const char *label);
+
+
+/**
+ * \brief Send an integer array to multiple roles (multicast).
+ *
+ * The message is serialised once, every role is sent a reference
+ * to the same message. A choice label to several roles can be
+ * sent as a labelled message of count 0.
+ *
+ * @param[in] arr         Array to send
+ * @param[in] count       Number of elements in array
+ * @param[in] roles       Roles to send to
+ * @param[in] nr_of_roles Number of roles to send to
+ * @param[in] label       Message label (can be null)
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_send)
+ */
+int msend_int_array(const int arr[], size_t count, role *roles[], int nr_of_roles, const char *label);
+
+
 /**
  * \brief Send an integer to multiple roles.
  *
@@ -54,6 +175,7 @@ int vsend_int(int val, int nr_of_roles, ...);
  * \brief Receive a message label.
  *
  * @param[out] label Variable to save message label to
+ *                   (allocated, must be freed by caller)
  * @param[in]  r     Role to receive from
  *
  * \returns 0 if successful, -1 otherwise and set errno
@@ -62,9 +184,36 @@ int vsend_int(int val, int nr_of_roles, ...);
 int probe_label(char **label, role *r);
 
 
+/**
+ * \brief Receive a message label as a label ID (no allocation).
+ *
+ * @param[out] label_id Variable to save label ID to (see session_label_id),
+ *                      -1 if the label is not in the local protocol
+ * @param[in]  r        Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int probe_label_id(int *label_id, role *r);
+
+
 int has_label(char *label, const char *_label);
 
 
+/**
+ * \brief Receive a synchronisation token (of a barrier).
+ *
+ * Messages the role sent before the token are held back,
+ * in order, for the receives that follow.
+ *
+ * @param[in] r Point-to-point role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int recv_token(role *r);
+
+
 /**
  * \brief Receive an integer (pre-allocated).
  *
@@ -90,6 +239,77 @@ int recv_int(int *dst, role *r);
 int recv_int_array(int *arr, size_t *count, role *r);
 
 
+/**
+ * \brief Receive a message into multiple integer arrays (scatter).
+ *
+ * Segments are filled in order, the count of each segment
+ * is updated to the number of elements received into it.
+ *
+ * @param[in,out] iov    Segments (pre-allocated) to receive into
+ * @param[in]     iovcnt Number of segments
+ * @param[in]     r      Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int recv_int_iov(msg_iov iov[], int iovcnt, role *r);
+
+
+/**
+ * \brief Receive a labelled integer array (pre-allocated).
+ *
+ * Equivalent to probe_label_id() followed by recv_int_array(),
+ * but a labelled message arrives as a single frame.
+ *
+ * @param[out]    label_id Variable to save label ID to (see probe_label_id)
+ * @param[out]    arr      Pointer to array storing recevied value
+ * @param[in,out] count    Pointer to variable storing number of elements in array
+ * @param[in]     r        Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int recv_int_array_labelled(int *label_id, int *arr, size_t *count, role *r);
+
+
+/**
+ * \brief Receive integers into an array described by a datatype.
+ *
+ * The message must hold (at least) type->size elements.
+ *
+ * @param[out] arr  Array to receive into
+ * @param[in]  type Datatype describing the elements to receive
+ * @param[in]  r    Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int recv_int_typed(int *arr, const datatype *type, role *r);
+
+
+/**
+ * \brief Receive an integer array without copying (borrowed view).
+ *
+ * The view points directly into the received message and must be
+ * released with release_view() when no longer needed.
+ *
+ * @param[out] view View of the received array
+ * @param[in]  r    Role to receive from
+ *
+ * \returns 0 if successful, -1 otherwise and set errno
+ *          (See man page of zmq_recv)
+ */
+int recv_int_array_view(msg_view *view, role *r);
+
+
+/**
+ * \brief Release a view returned by a *_view receive.
+ *
+ * @param[in,out] view View to release
+ */
+void release_view(msg_view *view);
+
+
 /**
  * \breif Broadcast an integer.
  *
@@ -105,6 +325,9 @@ int bcast_int(int val, session *s);
 /**
  * \breif Broadcast an integer array.
  *
+ * The array is published to every role by the sender,
+ * see bcast_int_array_at for a relayed (rooted) broadcast.
+ *
  * @param[in] arr   Array to send
  * @param[in] count Number of elements in array
  * @param[in] s     Session to broadcast to
@@ -141,15 +364,15 @@ int brecv_int_array(int *arr, size_t *count, session *s);
 
 
 /**
- * \brief Barrier synchronisation.
+ * \brief Receive a broadcast integer array without copying (borrowed view).
  *
- * @param[in] grp_role    Group role to perform barrier synchronisation on
- * @param[in] at_rolename Role name (string) to act as central coordinator
+ * @param[out] view View of the received array (see recv_int_array_view)
+ * @param[in]  s    Session to receive broadcast from
  *
  * \returns 0 if successful, -1 otherwise and set errno
  *          (See man page of zmq_recv)
  */
-int barrier(role *grp_role, char *at_rolename);
+int brecv_int_array_view(msg_view *view, session *s);
 
 
 #endif // SC__PRIMITIVES_H__
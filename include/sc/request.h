@@ -0,0 +1,223 @@
+#ifndef SC__REQUEST_H__
+#define SC__REQUEST_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * non-blocking communication module.
+ *
+ * Non-blocking primitives return a request handle immediately,
+ * the operation is carried out by a progress engine driven by
+ * the request_wait/request_test family of functions.
+ * Requests on the same endpoint complete in order of posting.
+ *
+ * Persistent requests bind buffer, count, role and label once
+ * (*_init), and are then started and completed repeatedly with
+ * request_start and request_wait without further allocation.
+ */
+
+#include "sc/types.h"
+
+/**
+ * \brief Start a non-blocking send of an integer.
+ *
+ * @param[in]  val   Value to send
+ * @param[in]  r     Role to send to
+ * @param[in]  label Message label (can be null)
+ * @param[out] req   Request handle
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int isend_int(int val, role *r, const char *label, request **req);
+
+
+/**
+ * \brief Start a non-blocking send of an integer array.
+ *
+ * The array is sent without copying and must not be modified
+ * until the request completes.
+ *
+ * @param[in]  arr   Array to send
+ * @param[in]  count Number of elements in array
+ * @param[in]  r     Role to send to
+ * @param[in]  label Message label (can be null)
+ * @param[out] req   Request handle
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int isend_int_array(const int arr[], size_t count, role *r, const char *label, request **req);
+
+
+/**
+ * \brief Start a non-blocking receive of an integer.
+ *
+ * @param[out] dst Pointer to variable storing recevied value
+ * @param[in]  r   Role to receive from
+ * @param[out] req Request handle
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int irecv_int(int *dst, role *r, request **req);
+
+
+/**
+ * \brief Start a non-blocking receive of an integer array (pre-allocated).
+ *
+ * @param[out]    arr   Pointer to array storing recevied value
+ * @param[in,out] count Pointer to variable storing number of elements in array
+ *                      (updated when the request completes)
+ * @param[in]     r     Role to receive from
+ * @param[out]    req   Request handle
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int irecv_int_array(int *arr, size_t *count, role *r, request **req);
+
+
+/**
+ * \brief Start a non-blocking broadcast of an integer array.
+ *
+ * @param[in]  arr   Array to send
+ * @param[in]  count Number of elements in array
+ * @param[in]  s     Session to broadcast to
+ * @param[out] req   Request handle
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int ibcast_int_array(const int arr[], size_t count, session *s, request **req);
+
+
+/**
+ * \brief Start a non-blocking receive of a broadcast integer array.
+ *
+ * @param[out]    arr   Pointer to array storing recevied value
+ * @param[in,out] count Pointer to variable storing number of elements in array
+ * @param[in]     s     Session to receive broadcast from
+ * @param[out]    req   Request handle
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int ibrecv_int_array(int *arr, size_t *count, session *s, request **req);
+
+
+/**
+ * \brief Create a persistent send request for an integer array.
+ *
+ * @param[in]  arr   Array to send (must not be modified while active)
+ * @param[in]  count Number of elements in array
+ * @param[in]  r     Role to send to
+ * @param[in]  label Message label (can be null)
+ * @param[out] req   Persistent request handle (inactive)
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int send_int_array_init(const int arr[], size_t count, role *r, const char *label, request **req);
+
+
+/**
+ * \brief Create a persistent receive request for an integer array.
+ *
+ * @param[out]    arr   Pointer to array storing recevied value
+ * @param[in,out] count Pointer to variable storing number of elements in array
+ *                      (capacity at creation, updated at every completion)
+ * @param[in]     r     Role to receive from
+ * @param[out]    req   Persistent request handle (inactive)
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int recv_int_array_init(int *arr, size_t *count, role *r, request **req);
+
+
+/**
+ * \brief Start an inactive persistent request.
+ *
+ * @param[in,out] req Persistent request handle
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int request_start(request *req);
+
+
+/**
+ * \brief Start a number of inactive persistent requests.
+ *
+ * @param[in]     count Number of requests
+ * @param[in,out] reqs  Persistent request handles
+ *
+ * \returns 0 if successful, -1 otherwise
+ */
+int request_startall(int count, request *reqs[]);
+
+
+/**
+ * \brief Free a persistent request (waiting for it first if active).
+ *
+ * @param[in,out] req Request handle (set to NULL)
+ */
+void request_free(request **req);
+
+
+/**
+ * \brief Wait for a request to complete.
+ *
+ * The request is freed and *req set to NULL on completion,
+ * persistent requests become inactive instead.
+ *
+ * @param[in,out] req Request handle (NULL or inactive handles complete immediately)
+ *
+ * \returns Result of the completed operation (0 if successful)
+ */
+int request_wait(request **req);
+
+
+/**
+ * \brief Test if a request has completed (without blocking).
+ *
+ * The request is freed and *req set to NULL on completion,
+ * persistent requests become inactive instead.
+ *
+ * @param[in,out] req  Request handle
+ * @param[out]    flag Set to 1 if the request has completed, 0 otherwise
+ *
+ * \returns Result of the completed operation (0 if successful or not completed)
+ */
+int request_test(request **req, int *flag);
+
+
+/**
+ * \brief Wait for all requests to complete.
+ *
+ * @param[in]     count Number of requests
+ * @param[in,out] reqs  Request handles (set to NULL on completion)
+ *
+ * \returns 0 if all completed successfully, -1 otherwise
+ */
+int request_waitall(int count, request *reqs[]);
+
+
+/**
+ * \brief Wait for any one request to complete.
+ *
+ * @param[in]     count Number of requests
+ * @param[in,out] reqs  Request handles (completed handle set to NULL)
+ * @param[out]    index Index of the completed request
+ *                      (-1 if all handles are NULL)
+ *
+ * \returns Result of the completed operation (0 if successful)
+ */
+int request_waitany(int count, request *reqs[], int *index);
+
+
+/**
+ * \brief Issue the outstanding requests of a type on an endpoint.
+ *
+ * Called by the blocking primitives before they use the endpoint,
+ * so messages are sent and received in the order they are posted.
+ *
+ * @param[in] s    Session
+ * @param[in] ep   Endpoint about to be used
+ * @param[in] type SESSION_REQ_SEND or SESSION_REQ_RECV
+ */
+void request_issue_pending(session *s, struct role_endpoint *ep, int type);
+
+
+#endif // SC__REQUEST_H__
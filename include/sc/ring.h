@@ -0,0 +1,35 @@
+#ifndef SC__RING_H__
+#define SC__RING_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * shared memory ring transport module.
+ *
+ * Connections between roles on the same host (`shm:host' in the
+ * connmgr config, generated for co-located roles) run over a POSIX
+ * shared memory segment holding one single-producer/single-consumer
+ * ring per direction. Frames are copied into and out of the ring
+ * without system calls; a side that has to wait spins for a while,
+ * then sleeps on a futex until the other side makes progress.
+ *
+ * A send never waits for room: what does not fit is queued on the
+ * connection and copied in while the role waits (receives,
+ * transport_poll, send_flush()), so two roles can both send more
+ * than a ring before receiving. Closing lingers until the queue is
+ * in the ring.
+ *
+ * The server role creates the segment (replacing one left by an
+ * earlier run), the client waits for it, attaches and removes its
+ * name; the segment is freed once both sides have closed.
+ */
+
+#include "sc/types.h"
+
+
+/**
+ * The shared memory ring transport (registered as "shm").
+ */
+extern const transport transport_shm;
+
+
+#endif // SC__RING_H__
@@ -14,9 +14,15 @@
 /**
  * \brief Initialise a sesssion.
  *
+ * Roles may run as threads of one process (see sc/inproc.h), each
+ * thread initialising its own session with its own argc/argv.
+ * Fails if two message labels of the protocol hash to the same
+ * on-wire key (see sc_label_hash), they must be renamed apart.
+ *
  * @param[in,out] argc     Command line argument count
  * @param[in,out] argv     Command line argument list
  * @param[out]    s        Pointer to session varible to create
+ *                         (NULL on failure)
  * @param[in]     scribble Endpoint Scribble file path for this session
  *                         (Must be constant string)
  */
@@ -26,16 +32,53 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble);
 /**
  * \brief Create a role group.
  *
+ * A sub-group of the local role and existing point-to-point roles.
+ * Messages sent to the group are delivered to its members only, over
+ * their point-to-point endpoints; receiving from the group takes the
+ * first message from any member. Every member creates the group with
+ * the same name, listing the other members. Group collectives
+ * (sc/collectives.h) run over the members.
+ *
  * @param[in,out] s     Session the new role group to create in.
  * @param[in]     name  Name of the new role group.
  * @param[in]     nrole Number of roles to group together.
  * @param[in]     ...   The handles to existing roles to group together. 
  *
- * \returns Handle to the newly created role group.
+ * \returns Handle to the newly created role group,
+ *          null if a member is not a point-to-point role.
  */
 role *session_group(session *s, const char *name, int nrole, ...);
 
 
+/**
+ * \brief Look up the ID of a message label.
+ *
+ * Label IDs are assigned once in session_init, numbered from 0 in
+ * order of first appearance in the local protocol, and are what
+ * probe_label_id() returns.
+ *
+ * @param[in] s     Session to look up label in.
+ * @param[in] label Message label.
+ *
+ * \returns Label ID, or -1 if label is not in the local protocol.
+ */
+int session_label_id(const session *s, const char *label);
+
+
+/**
+ * \brief Get the neighbours of the local role.
+ *
+ * Neighbours are the roles the local protocol sends to or
+ * receives from, ordered by role name.
+ *
+ * @param[in]  s          Session
+ * @param[out] neighbours Array of neighbour roles (owned by session)
+ *
+ * \returns Number of neighbours.
+ */
+int session_neighbours(const session *s, role ***neighbours);
+
+
 /**
  * \brief Terminate a session.
  *
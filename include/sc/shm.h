@@ -0,0 +1,66 @@
+#ifndef SC__SHM_H__
+#define SC__SHM_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * shared memory broadcast module.
+ *
+ * When every receiver of a broadcast runs on the same host as the
+ * sender, the payload is written once into a POSIX shared memory
+ * segment and only a small descriptor is published. Receivers map
+ * the segment and read the payload in place (recv_int_array_view)
+ * or copy it once. The segment counts its outstanding readers and
+ * is reused by the next broadcast once they are all done.
+ */
+
+#include <stddef.h>
+
+#include "sc/types.h"
+
+
+/**
+ * \brief Check whether a broadcast can go through shared memory.
+ *
+ * @param[in] grp_role Group role to broadcast to
+ * @param[in] count    Number of elements to broadcast
+ *
+ * \returns 1 if all receivers share the local host and the
+ *          payload is large enough to benefit, 0 otherwise.
+ */
+int shm_bcast_eligible(const role *grp_role, size_t count);
+
+
+/**
+ * \brief Broadcast an integer array through shared memory.
+ *
+ * @param[in] arr      Array to broadcast
+ * @param[in] count    Number of elements
+ * @param[in] grp_role Group role to broadcast to
+ *
+ * \returns 0 if successful, 1 if the segment is still in use
+ *          (caller should send normally), -1 otherwise.
+ */
+int shm_bcast_int_array(const int arr[], size_t count, role *grp_role);
+
+
+/**
+ * \brief Replace a received broadcast descriptor with its payload.
+ *
+ * @param[in,out] msg Message (zmq_msg_t) holding the descriptor,
+ *                    references the shared memory payload on return
+ * @param[in]     s   Session
+ *
+ * \returns 0 if successful, -1 otherwise.
+ */
+int shm_attach(void *msg, session *s);
+
+
+/**
+ * \brief Unmap and remove the shared memory segments of a session.
+ *
+ * @param[in] s Session
+ */
+void shm_cleanup(session *s);
+
+
+#endif // SC__SHM_H__
@@ -0,0 +1,48 @@
+#ifndef SC__TCP_H__
+#define SC__TCP_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * raw TCP transport module.
+ *
+ * Connections with a `tcp:host' host field in the connmgr config run
+ * over plain TCP sockets, without the ZeroMQ I/O thread. The parts of
+ * a message (label and payload) go out with a single writev, and are
+ * read into pooled buffers. Sockets are TCP_NODELAY; while the local
+ * protocol is in a run of sends to a role the socket is corked, and
+ * uncorked when the role next blocks (see send_flush()).
+ *
+ * Sockets are non-blocking, a send never waits for the peer: what the
+ * socket does not take is queued on the connection and written out
+ * while the role waits (receives, transport_poll, send_flush()), so
+ * two roles can both send more than a socket buffer before receiving.
+ * Closing an endpoint lingers until the queue is written out.
+ *
+ * Clients connect in session_init, retrying until the server role
+ * listens; servers accept the client on first use.
+ *
+ * With `uring:host' the connection is driven by a Linux io_uring
+ * shared by all endpoints of the session (a coordinator fanning in
+ * from many workers): sends are held back and submitted together
+ * when the role next blocks (send_flush(), transport_poll), polled
+ * endpoints read ahead with one submission, and completions are
+ * reaped in bulk. The wire format is that of `tcp:'; without io_uring
+ * support the connections fall back to plain sockets.
+ */
+
+#include "sc/types.h"
+
+
+/**
+ * The raw TCP transport (registered as "tcp").
+ */
+extern const transport transport_tcp;
+
+
+/**
+ * The io_uring TCP transport (registered as "uring").
+ */
+extern const transport transport_uring;
+
+
+#endif // SC__TCP_H__
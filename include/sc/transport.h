@@ -0,0 +1,67 @@
+#ifndef SC__TRANSPORT_H__
+#define SC__TRANSPORT_H__
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * transport module.
+ *
+ * Point-to-point endpoints send and receive through a transport
+ * backend (struct transport_t in sc/types.h). The backend of each
+ * connection is selected by the host field of the connmgr config:
+ * `name:host' selects the transport registered as name, any other
+ * host uses ZeroMQ (the default backend). Messages are always
+ * ZeroMQ messages (zmq_msg_t), whatever carries them.
+ */
+
+#include "sc/types.h"
+
+
+/**
+ * The ZeroMQ transport (PAIR sockets over tcp:// or ipc://).
+ */
+extern const transport transport_zmq;
+
+
+/**
+ * \brief Register a transport backend.
+ *
+ * @param[in] tp Transport (must stay valid for the process lifetime)
+ *
+ * \returns 0 if successful, -1 if too many transports are registered.
+ */
+int transport_register(const transport *tp);
+
+
+/**
+ * \brief Select the transport of a connection.
+ *
+ * @param[in]  host Host field of a connection record
+ * @param[out] addr Host with the transport name stripped
+ *
+ * \returns Transport named by the host prefix, transport_zmq otherwise.
+ */
+const transport *transport_select(const char *host, const char **addr);
+
+
+/**
+ * \brief Wait for endpoints to become ready.
+ *
+ * Endpoints holding back a received message (or whose transport
+ * buffered one) are ready to receive without waiting. Endpoints
+ * without a pollable socket or fd (shared memory rings) are checked
+ * repeatedly in between short polls of the others. Transports push
+ * out data they hold back (flush hook) before the endpoints are
+ * polled, io_uring endpoints submit their reads in the same batch.
+ *
+ * @param[in]  eps     Endpoints
+ * @param[in]  events  Events to wait for on each endpoint (ZMQ_POLLIN/ZMQ_POLLOUT)
+ * @param[out] revents Events ready on each endpoint
+ * @param[in]  n       Number of endpoints
+ * @param[in]  timeout Timeout (microseconds, -1 waits indefinitely)
+ *
+ * \returns Number of ready endpoints, -1 on error.
+ */
+int transport_poll(struct role_endpoint *eps[], const short events[], short revents[], int n, long timeout);
+
+
+#endif // SC__TRANSPORT_H__
@@ -6,18 +6,83 @@
  * type definitions.
  */
 
+#include <stddef.h>
+
 #define SESSION_ROLE_P2P     0
 #define SESSION_ROLE_GRP     1
 #define SESSION_ROLE_INDEXED 2
 
 
+/**
+ * Deallocation function for a buffer handed over to the runtime
+ * (same signature as zmq_free_fn).
+ */
+typedef void (sc_free_fn)(void *data, void *hint);
+
+struct session_t;
+struct transport_t;
+
 struct role_endpoint
 {
   char *name;
-  void *ptr;
+  char *host; // Host the role runs on (null if unknown).
+  const struct transport_t *tp; // Transport backend (see sc/transport.h).
+  void *ptr; // Transport handle (eg. ZeroMQ socket).
   char uri[6+255+7]; // tcp:// + FQDN + :port + \0
+
+  // Received message held back after its label is probed.
+  void *rx;
+  size_t rx_offset;
+  size_t rx_size;
+  unsigned int rx_parts; // Coalesced parts left in rx.
+  int rx_pending;
+  unsigned int rx_tokens; // Barrier tokens received ahead (see recv_token()).
+
+  // Frames received ahead of a barrier token, taken before the transport's.
+  void *rx_held; // zmq_msg_t array.
+  int *rx_held_more; // Frame is followed by another (ZMQ_RCVMORE).
+  unsigned int rx_nheld;
+  unsigned int rx_maxheld;
+  int rx_taken; // Last frame was taken from rx_held, rx_more is its flag.
+  int rx_more;
+
+  // Coalesced send batch (see session coalesce mode).
+  char *tx;
+  size_t tx_size;
+  size_t tx_cap;
+  unsigned int tx_parts;
+  int tx_hold; // Protocol sends runs of messages to this role.
+};
+
+/**
+ * A transport backend of point-to-point endpoints.
+ *
+ * Messages are zmq_msg_t (passed as void *), send and recv take
+ * the zmq_send/zmq_recv flags and follow their return conventions.
+ */
+struct transport_t
+{
+  const char *name;
+
+  // Connect an endpoint to the role at host:port (server side binds).
+  int (*connect)(struct role_endpoint *ep, struct session_t *s, const char *host, unsigned port, int server);
+  int (*send)(struct role_endpoint *ep, void *msg, int flags);
+  int (*recv)(struct role_endpoint *ep, void *msg, int flags);
+  // Last received frame is followed by another (ZMQ_RCVMORE).
+  int (*more)(struct role_endpoint *ep);
+  // Fill in a zmq_pollitem_t (socket or fd) for events (ZMQ_POLLOUT:
+  // nothing sent is still held back or in flight),
+  // returns 1 if the events are ready without polling,
+  // 2 if the item only signals progress (checked again when it fires),
+  // -1 if there is nothing to poll (checked again while waiting).
+  int (*poll)(struct role_endpoint *ep, void *item, short events);
+  int (*close)(struct role_endpoint *ep);
+  // Push out data held back by the transport (can be null).
+  int (*flush)(struct role_endpoint *ep);
 };
 
+typedef struct transport_t transport;
+
 struct role_group
 {
   char *name;
@@ -50,6 +115,56 @@ struct role_t
 
 typedef struct role_t role;
 
+/**
+ * A segment of a vectored (scatter-gather) message.
+ */
+struct msg_iov_t
+{
+  int *arr;
+  size_t count;
+};
+
+typedef struct msg_iov_t msg_iov;
+
+
+#define SESSION_REQ_SEND 0
+#define SESSION_REQ_RECV 1
+
+/**
+ * A non-blocking communication request.
+ *
+ * Created by the i* primitives and completed by the
+ * progress engine (see sc/request.h).
+ */
+struct request_t
+{
+  int type;
+  role *r;
+  struct role_endpoint *ep;
+
+  int labelled;
+  unsigned int key; // On-wire label key.
+  int *arr;
+  size_t count;
+  size_t *countp; // Receive count (in,out).
+  int val;        // Storage for single value sends.
+
+  int persistent;
+  int active;
+  int issued;
+  volatile int complete;
+  int rc;
+
+  struct request_t *next;
+};
+
+typedef struct request_t request;
+
+
+#define SESSION_BARRIER_CENTRAL       0
+#define SESSION_BARRIER_DISSEMINATION 1
+#define SESSION_BARRIER_TOURNAMENT    2
+
 /**
  * An endpoint session.
  *
@@ -61,10 +176,36 @@ struct session_t
   unsigned int nrole;
   role **roles;
   char *name;
+  char *host; // Host the local role runs on (null if unknown).
 
   // Lookup function.
   role *(*r)(struct session_t *, char *);
 
+  // Message labels in local protocol (index is the label ID).
+  unsigned int nlabel;
+  char **labels;
+  unsigned int *label_keys; // On-wire key of each label.
+
+  // Outstanding non-blocking requests (in order of posting).
+  struct request_t *reqs;
+  struct request_t *issuing; // Request the progress engine is carrying out.
+
+  // Coalesce P2P sends into batch frames (--coalesce).
+  int coalesce;
+
+  // Barrier algorithm (--barrier), SESSION_BARRIER_*.
+  int barrier;
+
+  // Roles the local protocol interacts with (ordered by name).
+  unsigned int nneighbour;
+  struct role_t **neighbours;
+
+  // Shared memory broadcast segments (see sc/shm.h).
+  void *shm;
+
+  // io_uring of the uring transport endpoints (see sc/tcp.h).
+  void *uring;
+
   // Extra data.
   void *ctx;
 };
@@ -72,4 +213,64 @@ struct session_t
 typedef struct session_t session;
 
 
+/**
+ * A read-only view of a received message.
+ *
+ * The data points into the underlying message and stays
+ * valid until the view is released with release_view().
+ */
+struct msg_view_t
+{
+  const int *arr;
+  size_t count;
+
+  void *msg; // Underlying message (release handle).
+  int vsm[8]; // Aligned copy of very small messages.
+};
+
+typedef struct msg_view_t msg_view;
+
+
+#define SC_DTYPE_CONTIG  0
+#define SC_DTYPE_VECTOR  1
+#define SC_DTYPE_INDEXED 2
+
+/**
+ * A derived datatype: layout of (non-contiguous)
+ * integers in an array, all offsets in elements.
+ *
+ * Constructed by the datatype_* functions (see sc/datatype.h)
+ * and normalised to the simplest kind describing the layout.
+ */
+struct datatype_t
+{
+  int kind;
+  size_t size;       // Number of elements.
+  size_t offset;     // First element.
+
+  size_t count;      // Number of blocks.
+  size_t blocklen;   // Block length (0 if blocks differ in length).
+  size_t stride;     // Distance between blocks (VECTOR).
+  size_t *blocklens; // Block lengths (INDEXED, null if uniform).
+  size_t *displs;    // Block displacements (INDEXED).
+};
+
+typedef struct datatype_t datatype;
+
+
+/**
+ * Message buffer pool statistics.
+ *
+ * Calls the pool made to the system allocator (see sc/pool.h).
+ */
+struct pool_stat_t
+{
+  unsigned long slabs; // Slabs carved into size class buffers.
+  unsigned long large; // Buffers of large size classes mapped (over 1MB).
+  size_t bytes;        // Total bytes of slabs.
+};
+
+typedef struct pool_stat_t pool_stat;
+
+
 #endif // SC__TYPES_H__
@@ -26,6 +26,16 @@ long long sc_time();
 double sc_time_diff(long long t0, long long t1);
 
 
+/**
+ * \brief Hash a message label to its on-wire key.
+ *
+ * @param[in] label Message label.
+ *
+ * \returns 32-bit FNV-1a hash of label.
+ */
+unsigned int sc_label_hash(const char *label);
+
+
 /**
  * \brief Print the Session C version.
  */
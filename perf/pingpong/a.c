@@ -6,6 +6,8 @@
 
 #include <sc.h>
 
+#include "common.h"
+
 int main(int argc, char *argv[])
 {
   session *s;
@@ -15,24 +17,57 @@ int main(int argc, char *argv[])
   if (argc < 3) return EXIT_FAILURE;
   int M = atoi(argv[1]);
   int N = atoi(argv[2]);
-  printf("M: %d, N: %d\n", M, N);
+  const char *mode = (argc > 3) ? argv[3] : "copy";
+  int nocopy = (strcmp(mode, "nocopy") == 0);
+  int persist = (strcmp(mode, "persist") == 0);
+  printf("M: %d, N: %d, mode: %s\n", M, N, mode);
 
   role *B = s->r(s, "B");
 
   int val[M];
   size_t sz = M;
-  long long start_time = sc_time();
+  pp_buf bufs[NBUFS];
+  pp_buf *buf;
+  request *sreq, *rreq;
 
   int i;
+  for (i=0; i<NBUFS; i++) {
+    bufs[i].data = (int *)malloc(M * sizeof(int));
+    bufs[i].busy = 0;
+  }
+
+  // Persistent requests: bound once, restarted every iteration.
+  send_int_array_init(val, (size_t)M, B, NULL, &sreq);
+  recv_int_array_init(val, &sz, B, &rreq);
+
+  long long start_time = sc_time();
+
   for (i=0; i<N; i++) {
-    memset(val, i, M * sizeof(int));
-    send_int_array(val, (size_t)M, B, NULL);
-    sz = M;
-    recv_int_array(val, &sz, B);
+    if (persist) {
+      memset(val, i, M * sizeof(int));
+      request_start(sreq);
+      request_wait(&sreq);
+      request_start(rreq);
+      request_wait(&rreq);
+    } else if (nocopy) {
+      buf = next_buf(bufs);
+      memset(buf->data, i, M * sizeof(int));
+      send_int_array_nocopy(buf->data, (size_t)M, B, NULL, recycle_buf, buf);
+      sz = M;
+      recv_int_array(val, &sz, B);
+    } else {
+      memset(val, i, M * sizeof(int));
+      send_int_array(val, (size_t)M, B, NULL);
+      sz = M;
+      recv_int_array(val, &sz, B);
+    }
   }
 
   long long end_time = sc_time();
 
+  request_free(&sreq);
+  request_free(&rreq);
+
   printf("%s: Time elapsed: %f sec\n", s->name, sc_time_diff(start_time, end_time));
 
   session_end(s);
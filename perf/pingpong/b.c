@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <sc.h>
 
@@ -14,23 +15,53 @@ int main(int argc, char *argv[])
   if (argc < 3) return EXIT_FAILURE;
   int M = atoi(argv[1]);
   int N = atoi(argv[2]);
-  printf("M: %d, N: %d\n", M, N);
+  const char *mode = (argc > 3) ? argv[3] : "copy";
+  int nocopy = (strcmp(mode, "nocopy") == 0);
+  int persist = (strcmp(mode, "persist") == 0);
+  printf("M: %d, N: %d, mode: %s\n", M, N, mode);
 
   role *A = s->r(s, "A");
 
   int val[M];
   size_t sz = M;
-  long long start_time = sc_time();
+  pp_buf bufs[NBUFS];
+  pp_buf *buf;
+  request *sreq, *rreq;
 
   int i;
+  for (i=0; i<NBUFS; i++) {
+    bufs[i].data = (int *)malloc(M * sizeof(int));
+    bufs[i].busy = 0;
+  }
+
+  // Persistent requests: bound once, restarted every iteration.
+  send_int_array_init(val, (size_t)M, A, NULL, &sreq);
+  recv_int_array_init(val, &sz, A, &rreq);
+
+  long long start_time = sc_time();
+
   for (i=0; i<N; i++) {
     sz = M;
-    recv_int_array(val, &sz, A);
-    send_int_array(val, (size_t)M, A, NULL);
+    if (persist) {
+      request_start(rreq);
+      request_wait(&rreq);
+      request_start(sreq);
+      request_wait(&sreq);
+    } else if (nocopy) {
+      buf = next_buf(bufs);
+      recv_int_array(buf->data, &sz, A);
+      send_int_array_nocopy(buf->data, (size_t)M, A, NULL, recycle_buf, buf);
+    } else {
+      recv_int_array(val, &sz, A);
+      send_int_array(val, (size_t)M, A, NULL);
+    }
   }
 
   long long end_time = sc_time();
 
+  request_free(&sreq);
+  request_free(&rreq);
+
   printf("%s: Time elapsed: %f sec\n", s->name, sc_time_diff(start_time, end_time));
 
   session_end(s);
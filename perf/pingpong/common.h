@@ -1 +1,29 @@
 #define ITERS 100
+
+/*
+ * Buffers for the zero-copy (nocopy) mode.
+ *
+ * A buffer given to send_int_array_nocopy() stays busy until the
+ * runtime hands it back through recycle_buf(), so it can be reused
+ * without a malloc/free per message.
+ */
+#define NBUFS 4
+
+typedef struct {
+  int *data;
+  volatile int busy;
+} pp_buf;
+
+static inline void recycle_buf(void *data, void *hint)
+{
+  __sync_lock_release(&((pp_buf *)hint)->busy);
+}
+
+static inline pp_buf *next_buf(pp_buf bufs[])
+{
+  int i = 0;
+  while (__sync_lock_test_and_set(&bufs[i].busy, 1)) {
+    i = (i + 1) % NBUFS;
+  }
+  return &bufs[i];
+}
@@ -13,6 +13,21 @@ echo
 ./runsc_ipc.sh $*
 sleep 5
 echo
+echo Session C SHM
+echo
+./runsc_shm.sh $*
+sleep 5
+echo
 echo Session C TCP
 echo
 ./runsc_tcp.sh $*
+sleep 5
+echo
+echo Session C raw TCP
+echo
+./runsc_rawtcp.sh $*
+sleep 5
+echo
+echo Session C io_uring
+echo
+./runsc_uring.sh $*
@@ -0,0 +1,4 @@
+#!/bin/sh
+
+./a -c connection_rawtcp.conf $* &
+./b -c connection_rawtcp.conf $*
@@ -0,0 +1,21 @@
+#!/bin/sh
+#
+# Compare copying, zero-copy (nocopy) and persistent request (persist)
+# sends across message sizes.
+# Usage: [CONF=connection.conf] ./runsc_sweep.sh N [sizes...]
+#
+
+CONF=${CONF:-connection.conf}
+N=${1:-100}
+shift
+SIZES=${*:-"1 16 256 4096 65536 262144"}
+
+for M in $SIZES; do
+  for MODE in copy nocopy persist; do
+    echo "Session C $CONF, M=$M, $MODE"
+    ./a -c $CONF $M $N $MODE &
+    ./b -c $CONF $M $N $MODE
+    wait
+    sleep 1
+  done
+done
@@ -0,0 +1,4 @@
+#!/bin/sh
+
+./a -c connection_uring.conf $* &
+./b -c connection_uring.conf $*
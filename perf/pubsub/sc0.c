@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sc.h>
+
+
+int main(int argc, char *argv[])
+{
+  session *s;
+  session_init(&argc, &argv, &s, "Pubsub_P0.spr");
+
+  if (argc < 2) return EXIT_FAILURE;
+  int N = atoi(argv[1]); // Number of elements per role
+
+  printf("N: %d\n", N);
+
+  role *grp = s->r(s, "_Others");
+  int size = group_size(grp);
+  int *all = (int *)calloc(N * size, sizeof(int));
+  int *val = (int *)calloc(N, sizeof(int));
+
+  barrier(grp, "P0");
+
+  long long start_time = sc_time();
+
+  scatter_int_array(all, val, N, grp, "P0"); // P0 -> P1
+  gather_int_array(val, all, N, grp, "P0");  // P1 -> P0
+
+  long long end_time = sc_time();
+
+  printf("%s: Time elapsed: %f sec\n", argv[0], sc_time_diff(start_time, end_time));
+
+  start_time = sc_time();
+  allgather_int_array(val, all, N, grp);
+  end_time = sc_time();
+
+  printf("%s: Allgather time elapsed: %f sec\n", argv[0], sc_time_diff(start_time, end_time));
+
+  free(val);
+  free(all);
+  session_end(s);
+
+  return EXIT_SUCCESS;
+}
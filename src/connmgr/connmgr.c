@@ -164,9 +164,11 @@ int connmgr_init(conn_rec **conns, host_map **role_hosts,
       }
 
 
-      if (strcmp(from_host, cr[conn_idx].host) == 0) {
-        cr[conn_idx].host = (char *)realloc(cr[conn_idx].host, sizeof(char) * (strlen(cr[conn_idx].host) + 4));
-        sprintf(cr[conn_idx].host, "ipc:%s", from_host);
+      if (strcmp(from_host, cr[conn_idx].host) == 0 && strncmp(from_host, "inproc:", 7) != 0) {
+        // Co-located roles talk through shared memory rings,
+        // roles of one process (inproc:name) through in-memory channels.
+        cr[conn_idx].host = (char *)realloc(cr[conn_idx].host, sizeof(char) * (strlen(cr[conn_idx].host) + 5));
+        sprintf(cr[conn_idx].host, "shm:%s", from_host);
       }
       // Find next unoccupied port.
       port_nr = -1;
@@ -492,7 +492,18 @@ receive                     :   message_signature FROM role_name role_param_bind
 
 /* --------------------------- Choice --------------------------- */
 
-l_choice                    :   CHOICE AT role_name local_interaction_blk or_local_interaction_blk {  $$ = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_CHOICE);  }
+l_choice                    :   CHOICE AT role_name local_interaction_blk or_local_interaction_blk {
+                                                                                                      $$ = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_CHOICE);
+                                                                                                      $$->choice->at = strdup($3);
+
+                                                                                                      $$->nchild = $5->nchild + 1;
+                                                                                                      $$->children = (st_node **)calloc(sizeof(st_node *), $$->nchild);
+                                                                                                      $$->children[0] = $4; // First or-block
+                                                                                                      int i;
+                                                                                                      for (i=0; i<$5->nchild; ++i) {
+                                                                                                          $$->children[1+i] = $5->children[i];
+                                                                                                      }
+                                                                                                   }
                             ;
 
 or_local_interaction_blk    :                                                     {  $$ = st_node_init((st_node *)malloc(sizeof(st_node)), ST_NODE_ROOT);  }
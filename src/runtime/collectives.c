@@ -0,0 +1,1125 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * collective communication module.
+ *
+ * Every pair of roles in a session is connected directly (P2P), so
+ * the collectives use flat schedules over the P2P endpoints of the
+ * group members: the root posts all its sends at once and receivers
+ * take chunks in order of arrival rather than in rank order.
+ *
+ * Reductions spread the arithmetic over the members instead: a
+ * binomial tree (reduce) or recursive doubling (allreduce, scan),
+ * finishing in log2(n) rounds.
+ *
+ * Where several members run on the same host (connmgr role-to-host
+ * map), the rooted broadcast and the point-to-point barriers run in
+ * two levels: within each host over IPC, and between one leader per
+ * host, so only the leaders exchange messages across hosts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zmq.h>
+
+#include "sc/collectives.h"
+#include "sc/pool.h"
+#include "sc/primitives.h"
+#include "sc/request.h"
+#include "sc/transport.h"
+#include "sc/utils.h"
+
+#define BCAST_SHORT    (12 * 1024)  // Bytes, binomial tree broadcast below.
+#define BCAST_PIPELINE (512 * 1024) // Bytes, pipelined chain broadcast above.
+#define BCAST_SEGMENT  (64 * 1024)  // Bytes per pipelined chain segment.
+
+#ifdef __DEBUG__
+extern int DEBUG_alltoall_count;
+extern long long DEBUG_alltoall_time;
+#endif
+
+
+/**
+ * A member of a collective,
+ * r is null for the local role.
+ */
+struct coll_rank
+{
+  const char *name;
+  role *r;
+};
+
+
+static int _rank_cmp(const void *a, const void *b)
+{
+  return strcmp(((const struct coll_rank *)a)->name, ((const struct coll_rank *)b)->name);
+}
+
+
+/**
+ * \brief Helper function to rank the members of a group role.
+ *
+ * @param[in]  grp_role Group role
+ * @param[out] ranks    Members in rank order (group_size() entries)
+ *
+ * \returns Rank of the local role, -1 if grp_role is not a group role.
+ */
+static int _ranks(role *grp_role, struct coll_rank ranks[])
+{
+  session *s = grp_role->s;
+  int endpoint_idx;
+  unsigned int role_idx;
+  int n = 0;
+
+  if (grp_role->type != SESSION_ROLE_GRP) {
+    fprintf(stderr, "Error: cannot perform collective with non group role!\n");
+    return -1;
+  }
+
+  for (endpoint_idx=0; endpoint_idx<grp_role->grp->nendpoint; ++endpoint_idx) {
+    for (role_idx=0; role_idx<s->nrole; ++role_idx) {
+      if (s->roles[role_idx]->type == SESSION_ROLE_P2P
+          && s->roles[role_idx]->p2p == grp_role->grp->endpoints[endpoint_idx]) {
+        ranks[n].name = s->roles[role_idx]->p2p->name;
+        ranks[n].r = s->roles[role_idx];
+        n++;
+        break;
+      }
+    }
+  }
+  ranks[n].name = s->name;
+  ranks[n].r = NULL;
+  n++;
+
+  qsort(ranks, n, sizeof(struct coll_rank), _rank_cmp);
+
+  for (n=0; ranks[n].r != NULL; ++n);
+  return n;
+}
+
+
+/**
+ * \brief Helper function to find the rank of a role.
+ *
+ */
+static int _find(const struct coll_rank ranks[], int n, const char *rolename)
+{
+  int rank;
+  for (rank=0; rank<n; ++rank) {
+    if (strcmp(ranks[rank].name, rolename) == 0) return rank;
+  }
+  fprintf(stderr, "%s: Role %s not in group\n", __FUNCTION__, rolename);
+  return -1;
+}
+
+
+/**
+ * \brief Helper function to receive the chunk of a member.
+ *
+ */
+static int _recv_chunk(const struct coll_rank ranks[], int rank, int *recvarr, size_t count)
+{
+  int rc;
+  size_t sz = count;
+
+  rc = recv_int_array(recvarr + rank * count, &sz, ranks[rank].r);
+  if (sz != count) {
+    fprintf(stderr, "%s: Received %zu elements from %s, expected %zu\n",
+        __FUNCTION__, sz, ranks[rank].name, count);
+  }
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to receive a chunk of count
+ * elements from every pending member, in order of arrival.
+ *
+ * pending[rank] is cleared as each chunk arrives.
+ */
+static int _recv_any(const struct coll_rank ranks[], int n, int pending[],
+                     int *recvarr, size_t count, session *s)
+{
+  int rc = 0;
+  int rank, item_idx, nitem, nready;
+  int npending = 0;
+  struct role_endpoint *eps[n];
+  short events[n], revents[n];
+  int item_rank[n];
+
+  for (rank=0; rank<n; ++rank) {
+    npending += pending[rank];
+  }
+
+  while (npending > 0) {
+    nitem = 0;
+    for (rank=0; rank<n; ++rank) {
+      if (!pending[rank]) continue;
+      eps[nitem] = ranks[rank].r->p2p;
+      events[nitem] = ZMQ_POLLIN;
+      item_rank[nitem] = rank;
+      nitem++;
+    }
+
+    // Held back messages (probe, batch, transport buffer) are ready straight away.
+    if ((nready = transport_poll(eps, events, revents, nitem, 0)) == 0) {
+      send_flush(s); // About to block, send out everything held back.
+      nready = transport_poll(eps, events, revents, nitem, -1);
+    }
+    if (nready < 0) return -1;
+
+    for (item_idx=0; item_idx<nitem; ++item_idx) {
+      if (!(revents[item_idx] & ZMQ_POLLIN)) continue;
+      rank = item_rank[item_idx];
+      rc |= _recv_chunk(ranks, rank, recvarr, count);
+      pending[rank] = 0;
+      npending--;
+    }
+  }
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to send one array to every other member.
+ *
+ * The array is copied once, every member is sent
+ * a reference to the same message.
+ */
+static int _send_all(const int arr[], size_t count, const struct coll_rank ranks[], int n, session *s)
+{
+  int rc = 0;
+  int rank;
+  zmq_msg_t msg, copy;
+  void *buf;
+
+  if (s->coalesce) { // Batch frames, one copy each.
+    for (rank=0; rank<n; ++rank) {
+      if (ranks[rank].r == NULL) continue;
+      rc |= send_int_array(arr, count, ranks[rank].r, NULL);
+    }
+    return rc;
+  }
+
+  buf = sc_pool_alloc(sizeof(int) * count);
+  memcpy(buf, arr, sizeof(int) * count);
+  zmq_msg_init_data(&msg, buf, sizeof(int) * count, sc_pool_free_fn, NULL);
+
+  for (rank=0; rank<n; ++rank) {
+    if (ranks[rank].r == NULL) continue;
+    request_issue_pending(s, ranks[rank].r->p2p, SESSION_REQ_SEND);
+    zmq_msg_init(&copy);
+    rc |= zmq_msg_copy(&copy, &msg);
+    rc |= ranks[rank].r->p2p->tp->send(ranks[rank].r->p2p, &copy, 0);
+    zmq_msg_close(&copy);
+  }
+  zmq_msg_close(&msg);
+
+  if (rc != 0) perror(__FUNCTION__);
+  return rc;
+}
+
+
+/**
+ * \brief Reduction kernel: inout[i] = inout[i] op in[i].
+ *
+ * One loop per operation, so each is vectorised by the compiler.
+ */
+static void _reduce(int op, int *restrict inout, const int *restrict in, size_t count)
+{
+  size_t i;
+
+  switch (op) {
+    case SC_OP_SUM:
+      for (i=0; i<count; ++i) inout[i] += in[i];
+      break;
+    case SC_OP_PROD:
+      for (i=0; i<count; ++i) inout[i] *= in[i];
+      break;
+    case SC_OP_MIN:
+      for (i=0; i<count; ++i) inout[i] = (in[i] < inout[i]) ? in[i] : inout[i];
+      break;
+    case SC_OP_MAX:
+      for (i=0; i<count; ++i) inout[i] = (in[i] > inout[i]) ? in[i] : inout[i];
+      break;
+    case SC_OP_BAND:
+      for (i=0; i<count; ++i) inout[i] &= in[i];
+      break;
+    case SC_OP_BOR:
+      for (i=0; i<count; ++i) inout[i] |= in[i];
+      break;
+    case SC_OP_BXOR:
+      for (i=0; i<count; ++i) inout[i] ^= in[i];
+      break;
+    default:
+      fprintf(stderr, "%s: Unknown reduction operation: %d\n", __FUNCTION__, op);
+  }
+}
+
+
+/**
+ * \brief Helper function to receive a partial result
+ * from a member and reduce it into acc.
+ */
+static int _recv_reduce(int op, int *acc, int *tmp, size_t count, const struct coll_rank *from)
+{
+  int rc;
+  size_t sz = count;
+
+  rc = recv_int_array(tmp, &sz, from->r);
+  if (sz != count) {
+    fprintf(stderr, "%s: Received %zu elements from %s, expected %zu\n",
+        __FUNCTION__, sz, from->name, count);
+  }
+  _reduce(op, acc, tmp, count);
+
+  return rc;
+}
+
+
+int group_size(role *grp_role)
+{
+  if (grp_role->type != SESSION_ROLE_GRP) return -1;
+  return grp_role->grp->nendpoint + 1;
+}
+
+
+int group_rank(role *grp_role, const char *rolename)
+{
+  int n = group_size(grp_role);
+  if (n < 0) return -1;
+
+  struct coll_rank ranks[n];
+  if (_ranks(grp_role, ranks) < 0) return -1;
+  return _find(ranks, n, rolename);
+}
+
+
+int scatter_int_array(const int sendarr[], int recvarr[], size_t count, role *grp_role, char *at_rolename)
+{
+  int rc = 0;
+  int n = group_size(grp_role);
+  int me, root, rank;
+  size_t sz = count;
+
+  if (n < 0) return -1;
+  struct coll_rank ranks[n];
+  if ((me = _ranks(grp_role, ranks)) < 0) return -1;
+  if ((root = _find(ranks, n, at_rolename)) < 0) return -1;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(%zu elements, rank %d of %d, root %d)\n", __FUNCTION__, count, me, n, root);
+#endif
+
+  if (me == root) {
+    for (rank=0; rank<n; ++rank) {
+      if (rank == me) continue;
+      rc |= send_int_array(sendarr + rank * count, count, ranks[rank].r, NULL);
+    }
+    memcpy(recvarr, sendarr + me * count, sizeof(int) * count);
+  } else {
+    rc = recv_int_array(recvarr, &sz, ranks[root].r);
+    if (sz != count) {
+      fprintf(stderr, "%s: Received %zu elements, expected %zu\n", __FUNCTION__, sz, count);
+    }
+  }
+
+  return rc;
+}
+
+
+int gather_int_array(const int sendarr[], int recvarr[], size_t count, role *grp_role, char *at_rolename)
+{
+  int rc = 0;
+  int n = group_size(grp_role);
+  int me, root, rank;
+
+  if (n < 0) return -1;
+  struct coll_rank ranks[n];
+  int pending[n];
+  if ((me = _ranks(grp_role, ranks)) < 0) return -1;
+  if ((root = _find(ranks, n, at_rolename)) < 0) return -1;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(%zu elements, rank %d of %d, root %d)\n", __FUNCTION__, count, me, n, root);
+#endif
+
+  if (me == root) {
+    memcpy(recvarr + me * count, sendarr, sizeof(int) * count);
+    for (rank=0; rank<n; ++rank) {
+      pending[rank] = (rank != me);
+    }
+    rc = _recv_any(ranks, n, pending, recvarr, count, grp_role->s);
+  } else {
+    rc = send_int_array(sendarr, count, ranks[root].r, NULL);
+  }
+
+  return rc;
+}
+
+
+int allgather_int_array(const int sendarr[], int recvarr[], size_t count, role *grp_role)
+{
+  int rc = 0;
+  int n = group_size(grp_role);
+  int me, rank;
+
+  if (n < 0) return -1;
+  struct coll_rank ranks[n];
+  int pending[n];
+  if ((me = _ranks(grp_role, ranks)) < 0) return -1;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(%zu elements, rank %d of %d)\n", __FUNCTION__, count, me, n);
+#endif
+
+  rc |= _send_all(sendarr, count, ranks, n, grp_role->s);
+
+  memcpy(recvarr + me * count, sendarr, sizeof(int) * count);
+  for (rank=0; rank<n; ++rank) {
+    pending[rank] = (rank != me);
+  }
+  rc |= _recv_any(ranks, n, pending, recvarr, count, grp_role->s);
+
+  return rc;
+}
+
+
+int reduce_int_array(const int sendarr[], int recvarr[], size_t count, int op, role *grp_role, char *at_rolename)
+{
+  int rc = 0;
+  int n = group_size(grp_role);
+  int me, root, rel, mask;
+  int *acc, *tmp;
+
+  if (n < 0) return -1;
+  struct coll_rank ranks[n];
+  if ((me = _ranks(grp_role, ranks)) < 0) return -1;
+  if ((root = _find(ranks, n, at_rolename)) < 0) return -1;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(%zu elements, rank %d of %d, root %d)\n", __FUNCTION__, count, me, n, root);
+#endif
+
+  acc = (me == root) ? recvarr : (int *)sc_pool_alloc(sizeof(int) * count);
+  tmp = (int *)sc_pool_alloc(sizeof(int) * count);
+  memcpy(acc, sendarr, sizeof(int) * count);
+
+  // Binomial tree rooted at root (ranks relative to root).
+  rel = (me - root + n) % n;
+  for (mask=1; mask<n; mask<<=1) {
+    if (rel & mask) {
+      rc |= send_int_array(acc, count, ranks[(rel - mask + root) % n].r, NULL);
+      break;
+    }
+    if (rel + mask < n) {
+      rc |= _recv_reduce(op, acc, tmp, count, &ranks[(rel + mask + root) % n]);
+    }
+  }
+
+  sc_pool_free(tmp);
+  if (acc != recvarr) sc_pool_free(acc);
+
+  return rc;
+}
+
+
+int allreduce_int_array(const int sendarr[], int recvarr[], size_t count, int op, role *grp_role)
+{
+  int rc = 0;
+  int n = group_size(grp_role);
+  int me, pof2, rem, newrank, newpeer, peer, mask;
+  int *tmp;
+
+  if (n < 0) return -1;
+  struct coll_rank ranks[n];
+  if ((me = _ranks(grp_role, ranks)) < 0) return -1;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(%zu elements, rank %d of %d)\n", __FUNCTION__, count, me, n);
+#endif
+
+  tmp = (int *)sc_pool_alloc(sizeof(int) * count);
+  memcpy(recvarr, sendarr, sizeof(int) * count);
+
+  for (pof2=1; pof2*2<=n; pof2<<=1);
+  rem = n - pof2;
+
+  // Fold the first 2*rem ranks pairwise so a power of two take part.
+  if (me < 2 * rem) {
+    if (me % 2 == 0) {
+      rc |= send_int_array(recvarr, count, ranks[me + 1].r, NULL);
+      newrank = -1;
+    } else {
+      rc |= _recv_reduce(op, recvarr, tmp, count, &ranks[me - 1]);
+      newrank = me / 2;
+    }
+  } else {
+    newrank = me - rem;
+  }
+
+  // Recursive doubling.
+  if (newrank != -1) {
+    for (mask=1; mask<pof2; mask<<=1) {
+      newpeer = newrank ^ mask;
+      peer = (newpeer < rem) ? newpeer * 2 + 1 : newpeer + rem;
+      rc |= send_int_array(recvarr, count, ranks[peer].r, NULL);
+      rc |= _recv_reduce(op, recvarr, tmp, count, &ranks[peer]);
+    }
+  }
+
+  // Hand the result back to the folded ranks.
+  if (me < 2 * rem) {
+    if (me % 2 == 0) {
+      size_t sz = count;
+      rc |= recv_int_array(recvarr, &sz, ranks[me + 1].r);
+    } else {
+      rc |= send_int_array(recvarr, count, ranks[me - 1].r, NULL);
+    }
+  }
+
+  sc_pool_free(tmp);
+
+  return rc;
+}
+
+
+int scan_int_array(const int sendarr[], int recvarr[], size_t count, int op, role *grp_role)
+{
+  int rc = 0;
+  int n = group_size(grp_role);
+  int me, mask, peer;
+  int *partial, *tmp;
+  size_t sz;
+
+  if (n < 0) return -1;
+  struct coll_rank ranks[n];
+  if ((me = _ranks(grp_role, ranks)) < 0) return -1;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(%zu elements, rank %d of %d)\n", __FUNCTION__, count, me, n);
+#endif
+
+  partial = (int *)sc_pool_alloc(sizeof(int) * count);
+  tmp = (int *)sc_pool_alloc(sizeof(int) * count);
+  memcpy(recvarr, sendarr, sizeof(int) * count);
+  memcpy(partial, sendarr, sizeof(int) * count);
+
+  // Recursive doubling: partial covers a block of ranks, recvarr the prefix.
+  for (mask=1; mask<n; mask<<=1) {
+    peer = me ^ mask;
+    if (peer >= n) continue;
+    rc |= send_int_array(partial, count, ranks[peer].r, NULL);
+    sz = count;
+    rc |= recv_int_array(tmp, &sz, ranks[peer].r);
+    _reduce(op, partial, tmp, count);
+    if (peer < me) {
+      _reduce(op, recvarr, tmp, count);
+    }
+  }
+
+  sc_pool_free(tmp);
+  sc_pool_free(partial);
+
+  return rc;
+}
+
+
+int alltoallv_int_array(const int sendarr[], const size_t sendcounts[], const size_t sdispls[],
+                        int recvarr[], const size_t recvcounts[], const size_t rdispls[],
+                        role *grp_role)
+{
+  int rc = 0;
+  int n = group_size(grp_role);
+  int me, step, dst, src, pof2;
+  size_t sz;
+#ifdef __DEBUG__
+  long long step_start, start = sc_time();
+#endif
+
+  if (n < 0) return -1;
+  struct coll_rank ranks[n];
+  if ((me = _ranks(grp_role, ranks)) < 0) return -1;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(rank %d of %d)\n", __FUNCTION__, me, n);
+#endif
+
+  memcpy(recvarr + rdispls[me], sendarr + sdispls[me], sizeof(int) * sendcounts[me]);
+
+  // Pairwise exchange (XOR partners for a power of two, shifted otherwise),
+  // one partner per member in every step so no member is sent to by many at once.
+  pof2 = ((n & (n - 1)) == 0);
+  for (step=1; step<n; ++step) {
+#ifdef __DEBUG__
+    step_start = sc_time();
+#endif
+    if (pof2) {
+      dst = src = me ^ step;
+    } else {
+      dst = (me + step) % n;
+      src = (me - step + n) % n;
+    }
+
+    rc |= send_int_array(sendarr + sdispls[dst], sendcounts[dst], ranks[dst].r, NULL);
+    sz = recvcounts[src];
+    rc |= recv_int_array(recvarr + rdispls[src], &sz, ranks[src].r);
+    if (sz != recvcounts[src]) {
+      fprintf(stderr, "%s: Received %zu elements from %s, expected %zu\n",
+          __FUNCTION__, sz, ranks[src].name, recvcounts[src]);
+    }
+#ifdef __DEBUG__
+    fprintf(stderr, "%s: step %d (-> %s, <- %s) %lld usec\n",
+        __FUNCTION__, step, ranks[dst].name, ranks[src].name, sc_time() - step_start);
+#endif
+  }
+
+#ifdef __DEBUG__
+  DEBUG_alltoall_count++;
+  DEBUG_alltoall_time += sc_time() - start;
+#endif
+
+  return rc;
+}
+
+
+int alltoall_int_array(const int sendarr[], int recvarr[], size_t count, role *grp_role)
+{
+  int n = group_size(grp_role);
+  int rank;
+
+  if (n < 0) return -1;
+  size_t counts[n];
+  size_t displs[n];
+  for (rank=0; rank<n; ++rank) {
+    counts[rank] = count;
+    displs[rank] = rank * count;
+  }
+
+  return alltoallv_int_array(sendarr, counts, displs, recvarr, counts, displs, grp_role);
+}
+
+
+int neighbour_exchange_int_array(const int sendarr[], int recvarr[], size_t count,
+                                 role *neighbours[], int nneighbour)
+{
+  int rc = 0;
+  int idx;
+
+  if (nneighbour <= 0) return 0;
+  struct coll_rank ranks[nneighbour];
+  int pending[nneighbour];
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s(%zu elements, %d neighbours)\n", __FUNCTION__, count, nneighbour);
+#endif
+
+  for (idx=0; idx<nneighbour; ++idx) {
+    if (neighbours[idx]->type != SESSION_ROLE_P2P) {
+      fprintf(stderr, "Error: cannot exchange with non point-to-point role!\n");
+      return -1;
+    }
+    ranks[idx].name = neighbours[idx]->p2p->name;
+    ranks[idx].r = neighbours[idx];
+    pending[idx] = 1;
+  }
+
+  // Transports queue what the peer has no room for yet, so sends
+  // never wait on a neighbour's receive.
+  for (idx=0; idx<nneighbour; ++idx) {
+    rc |= send_int_array(sendarr + idx * count, count, ranks[idx].r, NULL);
+  }
+  rc |= _recv_any(ranks, nneighbour, pending, recvarr, count, neighbours[0]->s);
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to find a chunk of an array split in n.
+ *
+ */
+static void _chunk(size_t count, int n, int i, size_t *offset, size_t *len)
+{
+  size_t base = count / n;
+  size_t extra = count % n;
+
+  *offset = i * base + ((size_t)i < extra ? (size_t)i : extra);
+  *len = base + ((size_t)i < extra);
+}
+
+
+/**
+ * \brief Helper function to receive exactly count elements.
+ *
+ */
+static int _recv_exact(int *arr, size_t count, const struct coll_rank *from)
+{
+  int rc;
+  size_t sz = count;
+
+  rc = recv_int_array(arr, &sz, from->r);
+  if (sz != count) {
+    fprintf(stderr, "%s: Received %zu elements from %s, expected %zu\n",
+        __FUNCTION__, sz, from->name, count);
+  }
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to find the rank of the local role in a set of members.
+ *
+ */
+static int _self(const struct coll_rank ranks[], int n)
+{
+  int rank;
+  for (rank=0; rank<n && ranks[rank].r != NULL; ++rank);
+  return (rank < n) ? rank : -1;
+}
+
+
+/**
+ * \brief Helper function to get the host of a member.
+ *
+ */
+static const char *_host(const struct coll_rank *member, const session *s)
+{
+  return (member->r == NULL) ? s->host : member->r->p2p->host;
+}
+
+
+/**
+ * \brief Helper function to split the members by host.
+ *
+ * The leader of a host is the root if the root runs on the host,
+ * otherwise its lowest ranked member. Leaders (in rank order) take
+ * part in the inter-host phase, members on the local host in the
+ * intra-host phase (lead is the rank of their leader in local).
+ * Roles on the same host are connected over IPC.
+ *
+ * \returns 1 if members share hosts and span more than one host
+ *          (two-level schedule pays off), 0 otherwise.
+ */
+static int _hosts(const struct coll_rank ranks[], int n, int root, const session *s,
+                  struct coll_rank leaders[], int *nleader,
+                  struct coll_rank local[], int *nlocal, int *lead)
+{
+  int rank, leader;
+  const char *host;
+
+  *nleader = 0;
+  *nlocal = 0;
+  *lead = 0;
+  for (rank=0; rank<n; ++rank) {
+    if (_host(&ranks[rank], s) == NULL) return 0;
+  }
+
+  for (rank=0; rank<n; ++rank) {
+    host = _host(&ranks[rank], s);
+    if (strcmp(host, _host(&ranks[root], s)) == 0) {
+      leader = root;
+    } else {
+      for (leader=0; strcmp(host, _host(&ranks[leader], s)) != 0; ++leader);
+    }
+    if (leader == rank) leaders[(*nleader)++] = ranks[rank];
+    if (strcmp(host, s->host) == 0) {
+      if (leader == rank) *lead = *nlocal;
+      local[(*nlocal)++] = ranks[rank];
+    }
+  }
+
+  return (*nleader > 1 && *nleader < n);
+}
+
+
+/**
+ * \brief Helper function to broadcast over a set of members.
+ *
+ * @param[in,out] arr   Array to broadcast (at root), to receive into (others)
+ * @param[in]     count Number of elements
+ * @param[in]     ranks Members in rank order
+ * @param[in]     n     Number of members
+ * @param[in]     me    Rank of the local role
+ * @param[in]     root  Rank of the root
+ */
+static int _bcast(int arr[], size_t count, const struct coll_rank ranks[], int n, int me, int root)
+{
+  int rc = 0;
+  int rel, mask, step;
+  size_t bytes = sizeof(int) * count;
+  size_t offset, len, seg;
+
+  if (n == 1) return 0;
+
+  rel = (me - root + n) % n;
+#define RANK(r) (&ranks[((r) + root) % n]) // Member from relative rank.
+
+  if (bytes < BCAST_SHORT || (size_t)n > count) { // Binomial tree.
+
+#ifdef __DEBUG__
+    fprintf(stderr, " <-> %s(%zu elements, rank %d of %d, root %d): binomial\n", __FUNCTION__, count, me, n, root);
+#endif
+    for (mask=1; mask<n; mask<<=1) {
+      if (rel & mask) {
+        rc |= _recv_exact(arr, count, RANK(rel - mask));
+        break;
+      }
+    }
+    for (mask>>=1; mask>0; mask>>=1) {
+      if (rel + mask < n) rc |= send_int_array(arr, count, RANK(rel + mask)->r, NULL);
+    }
+
+  } else if (bytes >= BCAST_PIPELINE && bytes / BCAST_SEGMENT >= (size_t)n) { // Pipelined chain.
+
+#ifdef __DEBUG__
+    fprintf(stderr, " <-> %s(%zu elements, rank %d of %d, root %d): chain\n", __FUNCTION__, count, me, n, root);
+#endif
+    seg = BCAST_SEGMENT / sizeof(int);
+    for (offset=0; offset<count; offset+=seg) {
+      len = (count - offset < seg) ? count - offset : seg;
+      if (rel > 0) rc |= _recv_exact(arr + offset, len, RANK(rel - 1));
+      if (rel < n-1) rc |= send_int_array(arr + offset, len, RANK(rel + 1)->r, NULL);
+    }
+
+  } else { // Scatter, then ring allgather: every rank (root too) sends ~2(n-1)/n of the array.
+
+#ifdef __DEBUG__
+    fprintf(stderr, " <-> %s(%zu elements, rank %d of %d, root %d): scatter-allgather\n", __FUNCTION__, count, me, n, root);
+#endif
+    if (rel == 0) {
+      for (step=1; step<n; ++step) {
+        _chunk(count, n, step, &offset, &len);
+        rc |= send_int_array(arr + offset, len, RANK(step)->r, NULL);
+      }
+    } else {
+      _chunk(count, n, rel, &offset, &len);
+      rc |= _recv_exact(arr + offset, len, RANK(0));
+    }
+
+    // The root already holds every chunk, the ring ends before it.
+    for (step=0; step<n-1; ++step) {
+      if (rel != n-1) {
+        _chunk(count, n, (rel - step + n) % n, &offset, &len);
+        rc |= send_int_array(arr + offset, len, RANK(rel + 1)->r, NULL);
+      }
+      if (rel != 0) {
+        _chunk(count, n, (rel - step - 1 + n) % n, &offset, &len);
+        rc |= _recv_exact(arr + offset, len, RANK(rel - 1));
+      }
+    }
+
+  }
+#undef RANK
+
+  return rc;
+}
+
+
+int bcast_int_array_at(int arr[], size_t count, role *grp_role, char *at_rolename)
+{
+  int rc = 0;
+  int n = group_size(grp_role);
+  int me, root, lme, nleader, nlocal, lead;
+
+  if (n < 0) return -1;
+  struct coll_rank ranks[n], leaders[n], local[n];
+  if ((me = _ranks(grp_role, ranks)) < 0) return -1;
+  if ((root = _find(ranks, n, at_rolename)) < 0) return -1;
+
+  if (!_hosts(ranks, n, root, grp_role->s, leaders, &nleader, local, &nlocal, &lead)) {
+    return _bcast(arr, count, ranks, n, me, root);
+  }
+
+#ifdef __DEBUG__
+  fprintf(stderr, " <-> %s: %d hosts, %d members on %s\n", __FUNCTION__, nleader, nlocal, grp_role->s->host);
+#endif
+  // Inter-host between the leaders, then from the leader to its host.
+  if ((lme = _self(leaders, nleader)) >= 0) {
+    rc |= _bcast(arr, count, leaders, nleader, lme, _find(leaders, nleader, at_rolename));
+  }
+  rc |= _bcast(arr, count, local, nlocal, _self(local, nlocal), lead);
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to send a barrier token (control frame).
+ *
+ */
+static int _token_send(const struct coll_rank *to)
+{
+  return send_token(to->r);
+}
+
+
+/**
+ * \brief Helper function to receive a barrier token.
+ *
+ * Messages between barrier_begin() and barrier_end() cannot take the
+ * token for data, nor the token a message (see recv_token()).
+ */
+static int _token_recv(const struct coll_rank *from)
+{
+  return recv_token(from->r);
+}
+
+
+/**
+ * \brief Central barrier (arrival) over the group PUB/SUB sockets.
+ *
+ */
+static int _barrier_central_begin(role *grp_role, char *at_rolename)
+{
+  int rc = 0;
+  zmq_msg_t msg;
+
+  if (strcmp(grp_role->s->name, at_rolename) == 0) return 0; // Master role
+
+  // Send S1 (Phase 1) messages.
+  zmq_msg_init_size(&msg, 2);
+  memcpy(zmq_msg_data(&msg), "S1", 2);
+  rc |= zmq_send(grp_role->grp->out->ptr, &msg, 0);
+  if (rc != 0) perror(__FUNCTION__);
+  zmq_msg_close(&msg);
+
+  return rc;
+}
+
+
+/**
+ * \brief Central barrier (completion) over the group PUB/SUB sockets.
+ *
+ */
+static int _barrier_central_end(role *grp_role, char *at_rolename)
+{
+  int rc = 0;
+  zmq_msg_t msg;
+  int i;
+
+  if (strcmp(grp_role->s->name, at_rolename) == 0) { // Master role
+
+    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_UNSUBSCRIBE, "", 0);
+    if (rc != 0) perror(__FUNCTION__);
+    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_SUBSCRIBE, "S1", 2);
+    if (rc != 0) perror(__FUNCTION__);
+
+    // Wait for S1 (Phase 1) messages.
+    for (i=0; i<grp_role->grp->nendpoint; ++i) {
+      zmq_msg_init(&msg);
+      rc |= zmq_recv(grp_role->grp->in->ptr, &msg, 0);
+      if (rc != 0) perror(__FUNCTION__);
+      zmq_msg_close (&msg);
+    }
+
+    // Reset filters.
+    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_UNSUBSCRIBE, "S1", 2);
+    if (rc != 0) perror(__FUNCTION__);
+    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_SUBSCRIBE, "", 0);
+    if (rc != 0) perror(__FUNCTION__);
+
+    zmq_msg_init_size(&msg, 2);
+    memcpy(zmq_msg_data(&msg), "S2", 2);
+    rc |= zmq_send(grp_role->grp->out->ptr, &msg, 0);
+    if (rc != 0) perror(__FUNCTION__);
+    zmq_msg_close(&msg);
+
+    // Synchronised.
+
+  } else { // Slave role
+
+    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_UNSUBSCRIBE, "", 0);
+    if (rc != 0) perror(__FUNCTION__);
+    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_SUBSCRIBE, "S2", 2);
+    if (rc != 0) perror(__FUNCTION__);
+
+    // Wait for S2 (Phase 2) messages.
+    zmq_msg_init(&msg);
+    rc |= zmq_recv(grp_role->grp->in->ptr, &msg, 0);
+    if (rc != 0) perror(__FUNCTION__);
+    zmq_msg_close(&msg);
+
+    // Reset filters.
+    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_UNSUBSCRIBE, "S2", 2);
+    if (rc != 0) perror(__FUNCTION__);
+    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_SUBSCRIBE, "", 0);
+    if (rc != 0) perror(__FUNCTION__);
+
+    // Synchronised.
+  }
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to start a point-to-point barrier over a set of members.
+ *
+ * The central barrier is coordinated by root over the point-to-point
+ * endpoints (sub-groups have no PUB/SUB sockets).
+ *
+ */
+static int _barrier_begin(const struct coll_rank ranks[], int n, int me, int root, int alg)
+{
+  int rc = 0;
+  int rel;
+
+  switch (alg) {
+    case SESSION_BARRIER_CENTRAL: // Arrive at the coordinator.
+      if (me != root) rc = _token_send(&ranks[root]);
+      break;
+    case SESSION_BARRIER_DISSEMINATION: // Round 0 token.
+      if (n > 1) rc = _token_send(&ranks[(me + 1) % n]);
+      break;
+    case SESSION_BARRIER_TOURNAMENT: // Leaves lose round 0 straight away.
+      rel = (me - root + n) % n;
+      if (rel & 1) rc = _token_send(&ranks[(rel - 1 + root) % n]);
+      break;
+  }
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to complete a point-to-point barrier over a set of members.
+ *
+ */
+static int _barrier_end(const struct coll_rank ranks[], int n, int me, int root, int alg)
+{
+  int rc = 0;
+  int rel, mask;
+
+  switch (alg) {
+
+    case SESSION_BARRIER_CENTRAL:
+      if (me != root) {
+        rc |= _token_recv(&ranks[root]);
+        break;
+      }
+      for (rel=0; rel<n; ++rel) {
+        if (rel != root) rc |= _token_recv(&ranks[rel]);
+      }
+      for (rel=0; rel<n; ++rel) {
+        if (rel != root) rc |= _token_send(&ranks[rel]);
+      }
+      break;
+
+    case SESSION_BARRIER_DISSEMINATION:
+      // Round k: notify rank+2^k, wait for rank-2^k (round 0 sent by _barrier_begin).
+      for (mask=1; mask<n; mask<<=1) {
+        if (mask > 1) rc |= _token_send(&ranks[(me + mask) % n]);
+        rc |= _token_recv(&ranks[(me - mask + n) % n]);
+      }
+      break;
+
+    case SESSION_BARRIER_TOURNAMENT:
+      rel = (me - root + n) % n;
+
+      // Arrival: winners of each round wait for the losers.
+      for (mask=1; mask<n; mask<<=1) {
+        if (rel & mask) {
+          if (mask > 1) rc |= _token_send(&ranks[(rel - mask + root) % n]);
+          break;
+        }
+        if (rel + mask < n) rc |= _token_recv(&ranks[(rel + mask + root) % n]);
+      }
+
+      // Release: wake up losers in reverse order.
+      if (rel != 0) rc |= _token_recv(&ranks[(rel - mask + root) % n]);
+      for (mask>>=1; mask>0; mask>>=1) {
+        if (rel + mask < n) rc |= _token_send(&ranks[(rel + mask + root) % n]);
+      }
+      break;
+  }
+
+  return rc;
+}
+
+
+int barrier_begin(role *grp_role, char *at_rolename)
+{
+  int n = group_size(grp_role);
+  int me, root = 0, nleader, nlocal, lead;
+
+  if (n < 0) {
+    fprintf(stderr, "Error: cannot perform barrier synchronisation with non group role!\n");
+    return -1;
+  }
+
+  send_flush(grp_role->s);
+
+  if (grp_role->s->barrier == SESSION_BARRIER_CENTRAL && grp_role->grp->out != NULL) {
+    return _barrier_central_begin(grp_role, at_rolename);
+  }
+
+  struct coll_rank ranks[n], leaders[n], local[n];
+  if ((me = _ranks(grp_role, ranks)) < 0) return -1;
+  if (grp_role->s->barrier != SESSION_BARRIER_DISSEMINATION
+      && (root = _find(ranks, n, at_rolename)) < 0) return -1;
+
+  if (_hosts(ranks, n, root, grp_role->s, leaders, &nleader, local, &nlocal, &lead)) {
+    // Arrive at the host leader, leaders start the inter-host phase in barrier_end.
+    if (_self(local, nlocal) == lead) return 0;
+    return _token_send(&local[lead]);
+  }
+
+  return _barrier_begin(ranks, n, me, root, grp_role->s->barrier);
+}
+
+
+int barrier_end(role *grp_role, char *at_rolename)
+{
+  int rc = 0;
+  int n = group_size(grp_role);
+  int me, root = 0, nleader, nlocal, lead, lme, lroot = 0;
+  int rank;
+
+  if (n < 0) {
+    fprintf(stderr, "Error: cannot perform barrier synchronisation with non group role!\n");
+    return -1;
+  }
+
+  if (grp_role->s->barrier == SESSION_BARRIER_CENTRAL && grp_role->grp->out != NULL) {
+    return _barrier_central_end(grp_role, at_rolename);
+  }
+
+  struct coll_rank ranks[n], leaders[n], local[n];
+  if ((me = _ranks(grp_role, ranks)) < 0) return -1;
+  if (grp_role->s->barrier != SESSION_BARRIER_DISSEMINATION
+      && (root = _find(ranks, n, at_rolename)) < 0) return -1;
+
+  if (!_hosts(ranks, n, root, grp_role->s, leaders, &nleader, local, &nlocal, &lead)) {
+    return _barrier_end(ranks, n, me, root, grp_role->s->barrier);
+  }
+
+  if (_self(local, nlocal) != lead) { // Released by the host leader.
+    return _token_recv(&local[lead]);
+  }
+
+  // Host leader: gather the host, synchronise the leaders, release the host.
+  for (rank=0; rank<nlocal; ++rank) {
+    if (rank != lead) rc |= _token_recv(&local[rank]);
+  }
+  lme = _self(leaders, nleader);
+  if (grp_role->s->barrier != SESSION_BARRIER_DISSEMINATION) lroot = _find(leaders, nleader, at_rolename);
+  rc |= _barrier_begin(leaders, nleader, lme, lroot, grp_role->s->barrier);
+  rc |= _barrier_end(leaders, nleader, lme, lroot, grp_role->s->barrier);
+  for (rank=0; rank<nlocal; ++rank) {
+    if (rank != lead) rc |= _token_send(&local[rank]);
+  }
+
+  return rc;
+}
+
+
+int barrier(role *grp_role, char *at_rolename)
+{
+  int rc = barrier_begin(grp_role, at_rolename);
+  if (rc != 0) return rc;
+  return barrier_end(grp_role, at_rolename);
+}
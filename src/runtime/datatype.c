@@ -0,0 +1,272 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * derived datatype module.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "sc/datatype.h"
+
+
+/**
+ * \brief Helper function to build a datatype from a block list.
+ *
+ * Adjacent blocks are merged, then the layout is reduced to the
+ * simplest kind: one block is CONTIG, equally sized and spaced
+ * blocks are a VECTOR, anything else stays INDEXED.
+ * Takes ownership of blocklens and displs.
+ */
+static int _normalise(size_t count, size_t *blocklens, size_t *displs, datatype **type)
+{
+  size_t i, n = 0;
+  int uniform = 1, regular = 1;
+  datatype *t;
+
+  if ((t = (datatype *)malloc(sizeof(datatype))) == NULL) {
+    perror(__FUNCTION__);
+    free(blocklens);
+    free(displs);
+    return -1;
+  }
+
+  t->size = 0;
+  for (i=0; i<count; ++i) {
+    if (blocklens[i] == 0) continue;
+    t->size += blocklens[i];
+    if (n > 0 && displs[n-1] + blocklens[n-1] == displs[i]) { // Adjacent block.
+      blocklens[n-1] += blocklens[i];
+    } else {
+      blocklens[n] = blocklens[i];
+      displs[n] = displs[i];
+      n++;
+    }
+  }
+
+  for (i=1; i<n; ++i) {
+    uniform &= (blocklens[i] == blocklens[0]);
+    regular &= (displs[i] > displs[i-1] && displs[i] - displs[i-1] == displs[1] - displs[0]);
+  }
+
+  t->count = n;
+  t->offset = (n > 0) ? displs[0] : 0;
+  t->blocklen = (n > 0 && uniform) ? blocklens[0] : 0;
+  t->stride = 0;
+  t->blocklens = NULL;
+  t->displs = NULL;
+
+  if (n <= 1) {
+    t->kind = SC_DTYPE_CONTIG;
+  } else if (uniform && regular) {
+    t->kind = SC_DTYPE_VECTOR;
+    t->stride = displs[1] - displs[0];
+  } else {
+    t->kind = SC_DTYPE_INDEXED;
+    t->displs = displs;
+    if (!uniform) t->blocklens = blocklens;
+  }
+
+  if (t->blocklens != blocklens) free(blocklens);
+  if (t->displs != displs) free(displs);
+
+#ifdef __DEBUG__
+  fprintf(stderr, "%s: kind %d, %zu elements in %zu blocks\n", __FUNCTION__, t->kind, t->size, t->count);
+#endif
+
+  *type = t;
+  return 0;
+}
+
+
+int datatype_vector(size_t count, size_t blocklen, size_t stride, datatype **type)
+{
+  size_t *blocklens = (size_t *)malloc(sizeof(size_t) * (count + 1));
+  size_t *displs = (size_t *)malloc(sizeof(size_t) * (count + 1));
+  size_t i;
+
+  for (i=0; i<count; ++i) {
+    blocklens[i] = blocklen;
+    displs[i] = i * stride;
+  }
+
+  return _normalise(count, blocklens, displs, type);
+}
+
+
+int datatype_indexed(size_t count, const size_t blocklens[], const size_t displs[], datatype **type)
+{
+  size_t *_blocklens = (size_t *)malloc(sizeof(size_t) * (count + 1));
+  size_t *_displs = (size_t *)malloc(sizeof(size_t) * (count + 1));
+
+  memcpy(_blocklens, blocklens, sizeof(size_t) * count);
+  memcpy(_displs, displs, sizeof(size_t) * count);
+
+  return _normalise(count, _blocklens, _displs, type);
+}
+
+
+int datatype_subarray(int ndims, const size_t sizes[], const size_t subsizes[],
+                      const size_t starts[], datatype **type)
+{
+  size_t count = 1;
+  size_t idx[ndims > 0 ? ndims : 1]; // ndims checked below.
+  size_t *blocklens, *displs;
+  size_t i, displ;
+  int dim;
+
+  if (ndims < 1) {
+    fprintf(stderr, "%s: Invalid number of dimensions %d\n", __FUNCTION__, ndims);
+    return -1;
+  }
+  for (dim=0; dim<ndims; ++dim) {
+    if (starts[dim] + subsizes[dim] > sizes[dim]) {
+      fprintf(stderr, "%s: Subarray out of bounds in dimension %d\n", __FUNCTION__, dim);
+      return -1;
+    }
+    if (dim < ndims-1) count *= subsizes[dim];
+    idx[dim] = 0;
+  }
+  if (subsizes[ndims-1] == 0) count = 0;
+
+  // One block per row of the last dimension.
+  blocklens = (size_t *)malloc(sizeof(size_t) * (count + 1));
+  displs = (size_t *)malloc(sizeof(size_t) * (count + 1));
+  for (i=0; i<count; ++i) {
+    displ = 0;
+    for (dim=0; dim<ndims; ++dim) {
+      displ = displ * sizes[dim] + starts[dim] + idx[dim];
+    }
+    blocklens[i] = subsizes[ndims-1];
+    displs[i] = displ;
+
+    for (dim=ndims-2; dim>=0; --dim) { // Next row.
+      if (++idx[dim] < subsizes[dim]) break;
+      idx[dim] = 0;
+    }
+  }
+
+  return _normalise(count, blocklens, displs, type);
+}
+
+
+void datatype_free(datatype **type)
+{
+  if (*type == NULL) return;
+
+  free((*type)->blocklens);
+  free((*type)->displs);
+  free(*type);
+  *type = NULL;
+}
+
+
+/**
+ * \brief Helper function to copy count blocks of len elements.
+ *
+ * Inlined with a constant len, the block copy becomes
+ * a fixed size (vector) load and store.
+ */
+static inline __attribute__((always_inline))
+void _copy_blocks(int *restrict dst, size_t dst_stride,
+                  const int *restrict src, size_t src_stride,
+                  size_t count, size_t len)
+{
+  size_t i;
+  for (i=0; i<count; ++i) {
+    memcpy(dst + i * dst_stride, src + i * src_stride, sizeof(int) * len);
+  }
+}
+
+
+/**
+ * \brief Helper function to gather single elements (eg. a matrix column).
+ *
+ */
+static void _gather1(int *restrict dst, const int *restrict src, size_t count, size_t stride)
+{
+  size_t i = 0;
+
+#ifdef __AVX2__
+  if (stride <= INT_MAX / 8) {
+    const __m256i vidx = _mm256_mullo_epi32(_mm256_set1_epi32((int)stride),
+                                            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    for (; i+8<=count; i+=8) {
+      _mm256_storeu_si256((__m256i *)(dst + i),
+                          _mm256_i32gather_epi32(src + i * stride, vidx, sizeof(int)));
+    }
+  }
+#endif
+
+  for (; i<count; ++i) {
+    dst[i] = src[i * stride];
+  }
+}
+
+
+void datatype_pack(const int *arr, const datatype *type, int *buf)
+{
+  const int *src = arr + type->offset;
+  size_t i;
+
+  switch (type->kind) {
+    case SC_DTYPE_CONTIG:
+      memcpy(buf, src, sizeof(int) * type->size);
+      break;
+
+    case SC_DTYPE_VECTOR:
+      switch (type->blocklen) {
+        case 1:  _gather1(buf, src, type->count, type->stride); break;
+        case 2:  _copy_blocks(buf, 2, src, type->stride, type->count, 2); break;
+        case 4:  _copy_blocks(buf, 4, src, type->stride, type->count, 4); break;
+        case 8:  _copy_blocks(buf, 8, src, type->stride, type->count, 8); break;
+        default: _copy_blocks(buf, type->blocklen, src, type->stride, type->count, type->blocklen);
+      }
+      break;
+
+    case SC_DTYPE_INDEXED:
+      for (i=0; i<type->count; ++i) {
+        size_t len = (type->blocklens == NULL) ? type->blocklen : type->blocklens[i];
+        memcpy(buf, arr + type->displs[i], sizeof(int) * len);
+        buf += len;
+      }
+      break;
+  }
+}
+
+
+void datatype_unpack(const int *buf, const datatype *type, int *arr)
+{
+  int *dst = arr + type->offset;
+  size_t i;
+
+  switch (type->kind) {
+    case SC_DTYPE_CONTIG:
+      memcpy(dst, buf, sizeof(int) * type->size);
+      break;
+
+    case SC_DTYPE_VECTOR:
+      switch (type->blocklen) {
+        case 1:  _copy_blocks(dst, type->stride, buf, 1, type->count, 1); break;
+        case 2:  _copy_blocks(dst, type->stride, buf, 2, type->count, 2); break;
+        case 4:  _copy_blocks(dst, type->stride, buf, 4, type->count, 4); break;
+        case 8:  _copy_blocks(dst, type->stride, buf, 8, type->count, 8); break;
+        default: _copy_blocks(dst, type->stride, buf, type->blocklen, type->count, type->blocklen);
+      }
+      break;
+
+    case SC_DTYPE_INDEXED:
+      for (i=0; i<type->count; ++i) {
+        size_t len = (type->blocklens == NULL) ? type->blocklen : type->blocklens[i];
+        memcpy(arr + type->displs[i], buf, sizeof(int) * len);
+        buf += len;
+      }
+      break;
+  }
+}
@@ -0,0 +1,451 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * in-process channel transport module.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include <zmq.h>
+
+#include "sc/inproc.h"
+
+#define INPROC_SLOTS 1024  // Messages queued per direction (power of two).
+#define INPROC_SPIN  4096  // Polls before sleeping on the futex.
+#define INPROC_NAP   50000 // Nanoseconds asleep while sends are queued.
+#define INPROC_PARTS 16    // Initial send queue length.
+
+#define INPROC_WAIT_ROOM  1 // Producer sleeps on tail.
+#define INPROC_WAIT_INPUT 2 // Producer sleeps on head of its receive queue.
+
+
+struct inproc_slot
+{
+  zmq_msg_t msg;
+  int more;
+};
+
+/**
+ * A single-producer/single-consumer message queue.
+ *
+ * head and tail count messages enqueued and dequeued (wrapping),
+ * each on its own cache line.
+ */
+struct inproc_queue
+{
+  volatile unsigned int head;
+  char pad0[60];
+  volatile unsigned int tail;
+  char pad1[60];
+  volatile int cons_sleeping; // Consumer waits on head.
+  volatile int prod_sleeping; // Producer waits (INPROC_WAIT_*).
+  char pad2[56];
+  struct inproc_slot slots[INPROC_SLOTS];
+};
+
+/**
+ * A channel: queues in both directions, shared by its two ends.
+ */
+struct inproc_chan
+{
+  char name[256];
+  unsigned port;
+  int refs; // Connected ends.
+  volatile int closed[2]; // End closed (server, client).
+  struct inproc_queue q[2];
+  struct inproc_chan *next;
+};
+
+/**
+ * One end of a channel, messages that do not fit in the queue
+ * are queued on the end.
+ */
+struct inproc_end
+{
+  struct inproc_chan *chan;
+  session *s;
+  struct inproc_queue *tx;
+  struct inproc_queue *rx;
+  int side; // 0: server, 1: client.
+  int more; // Last received message is followed by another.
+
+  // Messages queued for sending.
+  struct inproc_slot *parts;
+  int nparts;
+  int maxparts;
+};
+
+static struct inproc_chan *chans = NULL;
+static pthread_mutex_t chans_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static inline void _wait(volatile unsigned int *addr, unsigned int val)
+{
+#ifdef SYS_futex
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+#else
+  sched_yield();
+#endif
+}
+
+
+static inline void _nap(volatile unsigned int *addr, unsigned int val)
+{
+#ifdef SYS_futex
+  struct timespec timeout = { 0, INPROC_NAP };
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, &timeout, NULL, 0);
+#else
+  sched_yield();
+#endif
+}
+
+
+static inline void _wake(volatile unsigned int *addr)
+{
+#ifdef SYS_futex
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#endif
+}
+
+
+/**
+ * \brief Helper function to wait for a queued message.
+ *
+ */
+static void _wait_msg(struct inproc_queue *q)
+{
+  unsigned int head;
+  int spin;
+
+  for (spin=0; spin<INPROC_SPIN; ++spin) {
+    if (q->head != q->tail) return;
+  }
+
+  for (;;) {
+    q->cons_sleeping = 1;
+    __sync_synchronize();
+    if ((head = q->head) != q->tail) break;
+    _wait(&q->head, head);
+  }
+  q->cons_sleeping = 0;
+}
+
+
+/**
+ * \brief Helper function to queue a message on an end.
+ *
+ */
+static void _enqueue(struct inproc_end *end, zmq_msg_t *msg, int flags)
+{
+  struct inproc_slot *part;
+
+  if (end->nparts == end->maxparts) {
+    end->maxparts = (end->maxparts == 0) ? INPROC_PARTS : end->maxparts * 2;
+    end->parts = (struct inproc_slot *)realloc(end->parts, sizeof(struct inproc_slot) * end->maxparts);
+  }
+
+  // Sent like zmq_send: ownership moves to the transport, msg is left empty.
+  part = &end->parts[end->nparts++];
+  zmq_msg_init(&part->msg);
+  zmq_msg_move(&part->msg, msg);
+  part->more = (flags & ZMQ_SNDMORE) != 0;
+}
+
+
+/**
+ * \brief Helper function to move queued messages into free slots, without waiting.
+ *
+ */
+static void _drain(struct inproc_end *end)
+{
+  struct inproc_queue *q = end->tx;
+  struct inproc_slot *slot;
+  unsigned int head = q->head;
+  int n = 0;
+
+  while (n < end->nparts && head - q->tail < INPROC_SLOTS) {
+    slot = &q->slots[head & (INPROC_SLOTS - 1)];
+    zmq_msg_init(&slot->msg);
+    zmq_msg_move(&slot->msg, &end->parts[n].msg);
+    zmq_msg_close(&end->parts[n].msg);
+    slot->more = end->parts[n].more;
+    head++;
+    n++;
+  }
+  if (n == 0) return;
+
+  // zmq_msg_t is moved by copying (as zmq_msg_move does).
+  end->nparts -= n;
+  memmove(end->parts, end->parts + n, sizeof(struct inproc_slot) * end->nparts);
+
+  __sync_synchronize();
+  q->head = head;
+  __sync_synchronize();
+  if (q->cons_sleeping) _wake(&q->head);
+}
+
+
+/**
+ * \brief Helper function to move the messages queued on all ends of a session.
+ *
+ * \returns 1 if messages remain queued on ends other than end.
+ */
+static int _drain_all(struct inproc_end *end)
+{
+  struct role_endpoint *ep;
+  struct inproc_end *other;
+  unsigned role_idx;
+  int queued = 0;
+
+  _drain(end);
+  if (end->s == NULL) return 0;
+  for (role_idx=0; role_idx<end->s->nrole; ++role_idx) {
+    if (end->s->roles[role_idx]->type != SESSION_ROLE_P2P) continue;
+    ep = end->s->roles[role_idx]->p2p;
+    if (ep->tp != &transport_inproc || (other = (struct inproc_end *)ep->ptr) == NULL || other == end) continue;
+    if (other->nparts > 0) _drain(other);
+    queued |= (other->nparts > 0);
+  }
+
+  return queued;
+}
+
+
+/**
+ * \brief Helper function to wait for a message to receive.
+ *
+ * Queued messages are moved into the queues meanwhile, the peers
+ * may have to receive them before they send.
+ */
+static void _wait_input(struct inproc_end *end)
+{
+  struct inproc_queue *q = end->rx;
+  unsigned int head;
+  int others, spin;
+
+  for (spin=0; ; ++spin) {
+    others = _drain_all(end);
+    if (q->head != q->tail) return;
+    if (end->nparts == 0 && !others) break;
+    if (spin < INPROC_SPIN) continue;
+
+    // Woken by the peer's send, or by it taking a message (see _inproc_recv()).
+    q->cons_sleeping = 1;
+    if (end->nparts > 0) end->tx->prod_sleeping = INPROC_WAIT_INPUT;
+    __sync_synchronize();
+    if ((head = q->head) == q->tail
+        && (end->nparts == 0 || end->tx->head - end->tx->tail == INPROC_SLOTS)) {
+      _nap(&q->head, head); // Timed, our slots may free up in between.
+    }
+    end->tx->prod_sleeping = 0;
+    q->cons_sleeping = 0;
+  }
+
+  _wait_msg(q);
+}
+
+
+static int _inproc_connect(struct role_endpoint *ep, session *s, const char *host, unsigned port, int server)
+{
+  struct inproc_end *end;
+  struct inproc_chan *chan;
+
+  if (strlen(host) >= sizeof(chan->name)) {
+    fprintf(stderr, "%s: Process name %s too long\n", __FUNCTION__, host);
+    return -1;
+  }
+  snprintf(ep->uri, sizeof(ep->uri), "inproc://%s:%u", host, port);
+
+  pthread_mutex_lock(&chans_lock);
+  for (chan=chans; chan!=NULL; chan=chan->next) {
+    if (chan->port == port && strcmp(chan->name, host) == 0) break;
+  }
+  if (chan == NULL) { // First end to connect creates the channel.
+    if ((chan = (struct inproc_chan *)calloc(1, sizeof(struct inproc_chan))) == NULL) {
+      perror(__FUNCTION__);
+      pthread_mutex_unlock(&chans_lock);
+      return -1;
+    }
+    strcpy(chan->name, host);
+    chan->port = port;
+    chan->next = chans;
+    chans = chan;
+  }
+  chan->refs++;
+  pthread_mutex_unlock(&chans_lock);
+
+  end = (struct inproc_end *)malloc(sizeof(struct inproc_end));
+  end->chan = chan;
+  end->s = s;
+  end->tx = &chan->q[server ? 0 : 1];
+  end->rx = &chan->q[server ? 1 : 0];
+  end->side = server ? 0 : 1;
+  end->more = 0;
+  end->parts = NULL;
+  end->nparts = 0;
+  end->maxparts = 0;
+  ep->ptr = end;
+
+  return 0;
+}
+
+
+static int _inproc_send(struct role_endpoint *ep, void *msg, int flags)
+{
+  struct inproc_end *end = (struct inproc_end *)ep->ptr;
+  struct inproc_queue *q = end->tx;
+  struct inproc_slot *slot;
+
+  // What does not fit stays queued, moved in while the role waits
+  // (recv, poll, send_flush) or closes; a send never waits for the peer.
+  if (end->nparts > 0 || q->head - q->tail == INPROC_SLOTS) {
+    _enqueue(end, (zmq_msg_t *)msg, flags);
+    _drain(end);
+    return 0;
+  }
+
+  slot = &q->slots[q->head & (INPROC_SLOTS - 1)];
+
+  // Ownership moves to the queue, msg is left empty (as zmq_send).
+  zmq_msg_init(&slot->msg);
+  zmq_msg_move(&slot->msg, (zmq_msg_t *)msg);
+  slot->more = (flags & ZMQ_SNDMORE) != 0;
+
+  __sync_synchronize();
+  q->head++;
+  __sync_synchronize();
+  if (q->cons_sleeping) _wake(&q->head);
+
+  return 0;
+}
+
+
+static int _inproc_recv(struct role_endpoint *ep, void *msg, int flags)
+{
+  struct inproc_end *end = (struct inproc_end *)ep->ptr;
+  struct inproc_queue *q = end->rx;
+  struct inproc_slot *slot;
+
+  if (flags & ZMQ_NOBLOCK) {
+    _drain(end);
+    if (q->head == q->tail) {
+      errno = EAGAIN;
+      return -1;
+    }
+  }
+
+  _wait_input(end);
+  __sync_synchronize();
+  slot = &q->slots[q->tail & (INPROC_SLOTS - 1)];
+
+  zmq_msg_close((zmq_msg_t *)msg);
+  zmq_msg_init((zmq_msg_t *)msg);
+  zmq_msg_move((zmq_msg_t *)msg, &slot->msg);
+  zmq_msg_close(&slot->msg);
+  end->more = slot->more;
+
+  __sync_synchronize();
+  q->tail++;
+  __sync_synchronize();
+  if (q->prod_sleeping == INPROC_WAIT_ROOM) _wake(&q->tail);
+  else if (q->prod_sleeping == INPROC_WAIT_INPUT) _wake(&end->tx->head);
+
+  return 0;
+}
+
+
+static int _inproc_more(struct role_endpoint *ep)
+{
+  return ((struct inproc_end *)ep->ptr)->more;
+}
+
+
+static int _inproc_poll(struct role_endpoint *ep, void *item, short events)
+{
+  struct inproc_end *end = (struct inproc_end *)ep->ptr;
+
+  _drain(end);
+  if (events & ZMQ_POLLOUT) return (end->nparts == 0) ? 1 : -1;
+  if (end->rx->head != end->rx->tail) return 1;
+  return -1; // Nothing to hand to zmq_poll, check again.
+}
+
+
+static int _inproc_flush(struct role_endpoint *ep)
+{
+  _drain((struct inproc_end *)ep->ptr);
+  return 0;
+}
+
+
+static int _inproc_close(struct role_endpoint *ep)
+{
+  struct inproc_end *end = (struct inproc_end *)ep->ptr;
+  struct inproc_chan *chan = end->chan;
+  struct inproc_queue *q = end->tx;
+  struct inproc_chan **prev;
+  unsigned int tail;
+  int q_idx, part_idx;
+
+  // Linger until the queued messages are in the queue (as ZeroMQ does),
+  // unless the peer has closed.
+  for (_drain(end); end->nparts > 0 && !chan->closed[1 - end->side]; _drain(end)) {
+    q->prod_sleeping = INPROC_WAIT_ROOM;
+    __sync_synchronize();
+    tail = q->tail;
+    if (q->head - tail == INPROC_SLOTS && !chan->closed[1 - end->side]) {
+      _wait(&q->tail, tail);
+    }
+    q->prod_sleeping = 0;
+  }
+  chan->closed[end->side] = 1;
+  __sync_synchronize();
+  _wake(&end->rx->tail); // The peer may linger for a slot.
+
+  for (part_idx=0; part_idx<end->nparts; ++part_idx) {
+    zmq_msg_close(&end->parts[part_idx].msg);
+  }
+  free(end->parts);
+
+  pthread_mutex_lock(&chans_lock);
+  if (--chan->refs == 0) { // Last end, drop undelivered messages.
+    for (prev=&chans; *prev!=chan; prev=&(*prev)->next);
+    *prev = chan->next;
+    for (q_idx=0; q_idx<2; ++q_idx) {
+      for (; chan->q[q_idx].tail!=chan->q[q_idx].head; chan->q[q_idx].tail++) {
+        zmq_msg_close(&chan->q[q_idx].slots[chan->q[q_idx].tail & (INPROC_SLOTS - 1)].msg);
+      }
+    }
+    free(chan);
+  }
+  pthread_mutex_unlock(&chans_lock);
+
+  free(end);
+  ep->ptr = NULL;
+
+  return 0;
+}
+
+
+const transport transport_inproc = {
+  "inproc",
+  _inproc_connect,
+  _inproc_send,
+  _inproc_recv,
+  _inproc_more,
+  _inproc_poll,
+  _inproc_close,
+  _inproc_flush
+};
@@ -0,0 +1,367 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * message buffer pool module.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "sc/pool.h"
+
+#define POOL_MIN_SHIFT 6             // Smallest size class: 64 bytes.
+#define POOL_NCLASS    15            // Largest slab size class: 1MB.
+#define POOL_NLARGE    16            // Large size classes (mapped per buffer): 2MB to 64GB.
+#define POOL_LARGE     POOL_NCLASS   // First large size class.
+#define POOL_HUGE      (POOL_NCLASS + POOL_NLARGE) // Class of buffers passed to malloc.
+#define POOL_SLAB_SIZE (2 * 1024 * 1024)
+#define POOL_SLAB_MIN  4             // Minimum buffers per slab.
+#define POOL_CACHE_MAX 64            // Buffers per class cached by a thread.
+#define POOL_LARGE_MAX 4             // Buffers per large class kept in the depot.
+#define POOL_MAGIC     0x5c9001u
+
+
+/**
+ * Buffer header, the buffer follows.
+ * A free buffer holds the free list link.
+ */
+struct pool_hdr
+{
+  unsigned int cls;
+  unsigned int magic;
+  size_t size;
+};
+
+struct pool_list
+{
+  struct pool_hdr *head;
+  unsigned int n;
+};
+
+struct pool_depot
+{
+  volatile int lock;
+  struct pool_list list;
+};
+
+static __thread struct pool_list cache[POOL_NCLASS];
+static __thread int cache_registered = 0;
+
+static struct pool_depot depot[POOL_HUGE];
+static pool_stat stats;
+
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+
+static inline struct pool_hdr **_link(struct pool_hdr *hdr)
+{
+  return (struct pool_hdr **)(hdr + 1);
+}
+
+
+static inline unsigned int _class(size_t size)
+{
+  unsigned int cls = 0;
+  while (cls < POOL_HUGE && ((size_t)1 << (POOL_MIN_SHIFT + cls)) < size) {
+    cls++;
+  }
+  return cls;
+}
+
+
+static inline void _lock(struct pool_depot *d)
+{
+  while (__sync_lock_test_and_set(&d->lock, 1)) {
+    sched_yield();
+  }
+}
+
+
+static inline void _unlock(struct pool_depot *d)
+{
+  __sync_lock_release(&d->lock);
+}
+
+
+/**
+ * \brief Helper function to move up to n buffers between lists.
+ *
+ */
+static void _move(struct pool_list *dst, struct pool_list *src, unsigned int n)
+{
+  struct pool_hdr *hdr;
+
+  while (n-- > 0 && src->head != NULL) {
+    hdr = src->head;
+    src->head = *_link(hdr);
+    src->n--;
+    *_link(hdr) = dst->head;
+    dst->head = hdr;
+    dst->n++;
+  }
+}
+
+
+/**
+ * \brief Helper function to return the cache of an exiting thread.
+ *
+ */
+static void _cache_release(void *unused)
+{
+  unsigned int cls;
+
+  for (cls=0; cls<POOL_NCLASS; ++cls) {
+    _lock(&depot[cls]);
+    _move(&depot[cls].list, &cache[cls], cache[cls].n);
+    _unlock(&depot[cls]);
+  }
+}
+
+
+static void _cache_key_init()
+{
+  pthread_key_create(&cache_key, _cache_release);
+}
+
+
+/**
+ * \brief Helper function to make sure the cache of
+ * this thread is returned when the thread exits.
+ */
+static inline void _cache_register()
+{
+  if (cache_registered) return;
+
+  pthread_once(&cache_key_once, _cache_key_init);
+  pthread_setspecific(cache_key, cache);
+  cache_registered = 1;
+}
+
+
+/**
+ * \brief Helper function to carve a new slab into buffers
+ * of a size class, the buffers are added to list.
+ *
+ */
+static int _slab(unsigned int cls, struct pool_list *list)
+{
+  size_t bsize = sizeof(struct pool_hdr) + ((size_t)1 << (POOL_MIN_SHIFT + cls));
+  size_t size = POOL_SLAB_SIZE;
+  void *slab = MAP_FAILED;
+  struct pool_hdr *hdr;
+  size_t pos;
+
+  if (size < POOL_SLAB_MIN * bsize) { // Round up to whole (huge) pages.
+    size = (POOL_SLAB_MIN * bsize + POOL_SLAB_SIZE - 1) / POOL_SLAB_SIZE * POOL_SLAB_SIZE;
+  }
+
+#ifdef SC_POOL_HUGEPAGE
+  slab = mmap(NULL, size, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (slab == MAP_FAILED) {
+    slab = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (slab == MAP_FAILED) {
+      perror(__FUNCTION__);
+      return -1;
+    }
+#if defined(SC_POOL_HUGEPAGE) && defined(MADV_HUGEPAGE)
+    madvise(slab, size, MADV_HUGEPAGE);
+#endif
+  }
+
+#ifdef __DEBUG__
+  fprintf(stderr, "%s: %zu bytes for %zu byte buffers\n", __FUNCTION__, size, bsize);
+#endif
+
+  for (pos=0; pos+bsize<=size; pos+=bsize) {
+    hdr = (struct pool_hdr *)((char *)slab + pos);
+    hdr->cls = cls;
+    hdr->magic = POOL_MAGIC;
+    hdr->size = bsize - sizeof(struct pool_hdr);
+    *_link(hdr) = list->head;
+    list->head = hdr;
+    list->n++;
+  }
+
+  __sync_fetch_and_add(&stats.slabs, 1);
+  __sync_fetch_and_add(&stats.bytes, size);
+
+  return 0;
+}
+
+
+/**
+ * \brief Helper function to map a buffer of a large size class.
+ *
+ */
+static struct pool_hdr *_map_large(unsigned int cls)
+{
+  size_t size = sizeof(struct pool_hdr) + ((size_t)1 << (POOL_MIN_SHIFT + cls));
+  struct pool_hdr *hdr;
+
+  hdr = (struct pool_hdr *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (hdr == MAP_FAILED) {
+    perror(__FUNCTION__);
+    return NULL;
+  }
+#if defined(SC_POOL_HUGEPAGE) && defined(MADV_HUGEPAGE)
+  madvise(hdr, size, MADV_HUGEPAGE);
+#endif
+
+#ifdef __DEBUG__
+  fprintf(stderr, "%s: %zu bytes\n", __FUNCTION__, size);
+#endif
+
+  hdr->cls = cls;
+  hdr->magic = POOL_MAGIC;
+  hdr->size = size - sizeof(struct pool_hdr);
+  __sync_fetch_and_add(&stats.large, 1);
+
+  return hdr;
+}
+
+
+/**
+ * \brief Helper function to refill the cache of a
+ * size class from the depot (or a new slab).
+ */
+static int _refill(unsigned int cls)
+{
+  int rc = 0;
+
+  _cache_register();
+
+  _lock(&depot[cls]);
+  if (depot[cls].list.head == NULL) {
+    rc = _slab(cls, &depot[cls].list);
+  }
+  _move(&cache[cls], &depot[cls].list, POOL_CACHE_MAX / 2);
+  _unlock(&depot[cls]);
+
+  return rc;
+}
+
+
+void *sc_pool_alloc(size_t size)
+{
+  unsigned int cls = _class(size);
+  struct pool_hdr *hdr;
+
+  if (cls == POOL_HUGE) {
+    if ((hdr = (struct pool_hdr *)malloc(sizeof(struct pool_hdr) + size)) == NULL) {
+      return NULL;
+    }
+    __sync_fetch_and_add(&stats.large, 1);
+    hdr->cls = POOL_HUGE;
+    hdr->magic = POOL_MAGIC;
+    hdr->size = size;
+    return hdr + 1;
+  }
+
+  if (cls >= POOL_LARGE) { // Few and large, straight from the depot.
+    _lock(&depot[cls]);
+    if ((hdr = depot[cls].list.head) != NULL) {
+      depot[cls].list.head = *_link(hdr);
+      depot[cls].list.n--;
+    }
+    _unlock(&depot[cls]);
+    if (hdr == NULL && (hdr = _map_large(cls)) == NULL) {
+      return NULL;
+    }
+    return hdr + 1;
+  }
+
+  if (cache[cls].head == NULL && (_refill(cls) != 0 || cache[cls].head == NULL)) {
+    return NULL;
+  }
+
+  hdr = cache[cls].head;
+  cache[cls].head = *_link(hdr);
+  cache[cls].n--;
+
+  return hdr + 1;
+}
+
+
+void *sc_pool_realloc(void *ptr, size_t size)
+{
+  void *buf;
+
+  if (ptr == NULL) return sc_pool_alloc(size);
+  if (size <= sc_pool_size(ptr)) return ptr;
+
+  if ((buf = sc_pool_alloc(size)) == NULL) return NULL;
+  memcpy(buf, ptr, sc_pool_size(ptr));
+  sc_pool_free(ptr);
+
+  return buf;
+}
+
+
+void sc_pool_free(void *ptr)
+{
+  struct pool_hdr *hdr;
+  unsigned int cls;
+
+  if (ptr == NULL) return;
+
+  hdr = (struct pool_hdr *)ptr - 1;
+  assert(hdr->magic == POOL_MAGIC); // Not allocated from the pool
+  cls = hdr->cls;
+
+  if (cls == POOL_HUGE) {
+    free(hdr);
+    return;
+  }
+
+  if (cls >= POOL_LARGE) {
+    _lock(&depot[cls]);
+    if (depot[cls].list.n < POOL_LARGE_MAX) {
+      *_link(hdr) = depot[cls].list.head;
+      depot[cls].list.head = hdr;
+      depot[cls].list.n++;
+      hdr = NULL;
+    }
+    _unlock(&depot[cls]);
+    if (hdr != NULL) munmap(hdr, sizeof(struct pool_hdr) + hdr->size);
+    return;
+  }
+
+  _cache_register();
+  *_link(hdr) = cache[cls].head;
+  cache[cls].head = hdr;
+  cache[cls].n++;
+
+  // Buffers freed by another thread (eg. ZeroMQ I/O thread) flow back here.
+  if (cache[cls].n > POOL_CACHE_MAX) {
+    _lock(&depot[cls]);
+    _move(&depot[cls].list, &cache[cls], POOL_CACHE_MAX / 2);
+    _unlock(&depot[cls]);
+  }
+}
+
+
+void sc_pool_free_fn(void *data, void *hint)
+{
+  sc_pool_free(data);
+}
+
+
+size_t sc_pool_size(const void *ptr)
+{
+  return ((const struct pool_hdr *)ptr - 1)->size;
+}
+
+
+void sc_pool_stats(pool_stat *stat)
+{
+  __sync_synchronize();
+  memcpy(stat, &stats, sizeof(pool_stat));
+}
@@ -6,13 +6,24 @@
 
 #include <assert.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <zmq.h>
 
+#include "sc/datatype.h"
+#include "sc/pool.h"
 #include "sc/primitives.h"
+#include "sc/request.h"
+#include "sc/shm.h"
+#include "sc/transport.h"
+#include "sc/utils.h"
+
+#define BATCH_MAX 65536 // Coalesced batch size (bytes) to flush at.
+#define TOKEN_LABEL "_token" // Reserved label of barrier tokens.
+#define HELD_FRAMES 8 // Initial number of frames held back ahead of a token.
 
 
 /**
@@ -25,65 +36,114 @@ void _dealloc(void *data, void *hint)
 }
 
 
-inline int send_int(int val, role *r, const char *label)
+/**
+ * \brief Helper function to check if messages to/from a role
+ * travel in coalesced batches over point-to-point endpoints.
+ */
+static inline int _batched(const role *r)
 {
-  return send_int_array(&val, 1, r, label);
+  return r->s->coalesce
+      && (r->type == SESSION_ROLE_P2P || (r->type == SESSION_ROLE_GRP && r->grp->out == NULL));
 }
 
 
-int send_int_array(const int arr[], size_t count, role *r, const char *label)
+/**
+ * \brief Helper function to send a message to every member of a sub-group.
+ *
+ * Members are sent over their point-to-point endpoints,
+ * each is handed a reference to the same message.
+ */
+static int _send_members(zmq_msg_t *msg, role *r, const char *label)
 {
   int rc = 0;
-  zmq_msg_t msg;
-  size_t size = sizeof(int) * count;
-
+  int endpoint_idx;
+  zmq_msg_t copy, msg_label;
+  unsigned int key;
 
 #ifdef __DEBUG__
-  fprintf(stderr, " --> %s ", __FUNCTION__);
+  fprintf(stderr, "mcast -> %s(%d endpoints) ", r->grp->name, r->grp->nendpoint);
 #endif
+  if (label != NULL) key = sc_label_hash(label);
+
+  for (endpoint_idx=0; endpoint_idx<r->grp->nendpoint; ++endpoint_idx) {
+    request_issue_pending(r->s, r->grp->endpoints[endpoint_idx], SESSION_REQ_SEND);
+    if (label != NULL) {
+      zmq_msg_init_size(&msg_label, sizeof(key));
+      memcpy(zmq_msg_data(&msg_label), &key, sizeof(key));
+      rc |= r->grp->endpoints[endpoint_idx]->tp->send(r->grp->endpoints[endpoint_idx], &msg_label, ZMQ_SNDMORE);
+      zmq_msg_close(&msg_label);
+    }
+    zmq_msg_init(&copy);
+    zmq_msg_copy(&copy, msg);
+    rc |= r->grp->endpoints[endpoint_idx]->tp->send(r->grp->endpoints[endpoint_idx], &copy, 0);
+    zmq_msg_close(&copy);
+  }
+  zmq_msg_close(msg);
+
+  if (rc != 0) perror(__FUNCTION__);
 
-  if (label != NULL) {
 #ifdef __DEBUG__
-    fprintf(stderr, "{label: %s}", label);
+  fprintf(stderr, ".\n");
 #endif
-    zmq_msg_t msg_label;
-    char *buf_label = (char *)calloc(sizeof(char), strlen(label));
-    memcpy(buf_label, label, strlen(label));
-    zmq_msg_init_data(&msg_label, buf_label, strlen(label), _dealloc, NULL);
-    switch (r->type) {
-      case SESSION_ROLE_P2P:
-        rc = zmq_send(r->p2p->ptr, &msg_label, ZMQ_SNDMORE);
-        break;
-      case SESSION_ROLE_GRP:
-        rc = zmq_send(r->grp->out->ptr, &msg_label, ZMQ_SNDMORE);
-        break;
-    default:
-        fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
-    }
-    zmq_msg_close(&msg_label);
-  }
 
-  int *buf = (int *)malloc(size);
-  memcpy(buf, arr, size);
+  return rc;
+}
+
+
+inline int send_int(int val, role *r, const char *label)
+{
+  return send_int_array(&val, 1, r, label);
+}
+
+
+/**
+ * \brief Helper function to send a message (and its label) to a role.
+ *
+ * A label given here is sent as a separate frame before the message
+ * (used when the payload cannot be copied behind a label key).
+ * Message is closed after sending.
+ */
+static int _send_msg(zmq_msg_t *msg, role *r, const char *label)
+{
+  int rc = 0;
+  struct role_endpoint *ep = NULL;
 
-  zmq_msg_init_data(&msg, buf, size, _dealloc, NULL);
   switch (r->type) {
     case SESSION_ROLE_P2P:
-      rc = zmq_send(r->p2p->ptr, &msg, 0);
+      ep = r->p2p;
       break;
     case SESSION_ROLE_GRP:
+      if (r->grp->out == NULL) return _send_members(msg, r, label); // Sub-group.
 #ifdef __DEBUG__
       fprintf(stderr, "bcast -> %s(%d endpoints) ", r->grp->name, r->grp->nendpoint);
 #endif
-      rc = zmq_send(r->grp->out->ptr, &msg, 0);
+      ep = r->grp->out;
       break;
     default:
       fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
+      zmq_msg_close(msg);
+      return -1;
   }
-  zmq_msg_close(&msg);
+  request_issue_pending(r->s, ep, SESSION_REQ_SEND); // Earlier non-blocking sends first.
+
+  if (label != NULL) {
+#ifdef __DEBUG__
+    fprintf(stderr, "{label: %s}", label);
+#endif
+    // Labels travel as their (fixed-size) key, no allocation needed.
+    zmq_msg_t msg_label;
+    unsigned int key = sc_label_hash(label);
+    zmq_msg_init_size(&msg_label, sizeof(key));
+    memcpy(zmq_msg_data(&msg_label), &key, sizeof(key));
+    rc |= ep->tp->send(ep, &msg_label, ZMQ_SNDMORE);
+    zmq_msg_close(&msg_label);
+  }
+
+  rc |= ep->tp->send(ep, msg, 0);
+  zmq_msg_close(msg);
 
   if (rc != 0) perror(__FUNCTION__);
- 
+
 #ifdef __DEBUG__
   fprintf(stderr, ".\n");
 #endif
@@ -92,27 +152,309 @@ int send_int_array(const int arr[], size_t count, role *r, const char *label)
 }
 
 
-int vsend_int(int val, int nr_of_roles, ...)
+/**
+ * \brief Helper function to append a message part to the
+ * coalesced send batch of an endpoint.
+ *
+ * A batch is a single frame: part count, then every part
+ * as its size followed by the part (label key and payload).
+ */
+static void _batch_append(struct role_endpoint *ep, const unsigned int *key,
+                          const msg_iov iov[], int iovcnt)
+{
+  unsigned int part_size = (key != NULL) ? sizeof(*key) : 0;
+  size_t need;
+  int i;
+
+  for (i=0; i<iovcnt; ++i) {
+    part_size += sizeof(int) * iov[i].count;
+  }
+
+  if (ep->tx == NULL) {
+    ep->tx_cap = BATCH_MAX;
+    ep->tx = (char *)sc_pool_alloc(ep->tx_cap);
+    ep->tx_size = sizeof(ep->tx_parts);
+    ep->tx_parts = 0;
+  }
+  need = ep->tx_size + sizeof(part_size) + part_size;
+  if (need > ep->tx_cap) {
+    ep->tx_cap = (need > 2 * ep->tx_cap) ? need : 2 * ep->tx_cap;
+    ep->tx = (char *)sc_pool_realloc(ep->tx, ep->tx_cap);
+  }
+
+  memcpy(ep->tx + ep->tx_size, &part_size, sizeof(part_size));
+  ep->tx_size += sizeof(part_size);
+  if (key != NULL) {
+    memcpy(ep->tx + ep->tx_size, key, sizeof(*key));
+    ep->tx_size += sizeof(*key);
+  }
+  for (i=0; i<iovcnt; ++i) {
+    memcpy(ep->tx + ep->tx_size, iov[i].arr, sizeof(int) * iov[i].count);
+    ep->tx_size += sizeof(int) * iov[i].count;
+  }
+  ep->tx_parts++;
+}
+
+
+/**
+ * \brief Helper function to send the coalesced batch of an endpoint.
+ *
+ */
+static int _batch_flush(struct role_endpoint *ep)
+{
+  int rc = 0;
+  zmq_msg_t msg;
+
+  if (ep->tx_parts == 0) return 0;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " --> %s(%u parts) .\n", __FUNCTION__, ep->tx_parts);
+#endif
+
+  memcpy(ep->tx, &ep->tx_parts, sizeof(ep->tx_parts));
+  zmq_msg_init_data(&msg, ep->tx, ep->tx_size, sc_pool_free_fn, NULL);
+  rc = ep->tp->send(ep, &msg, 0);
+  zmq_msg_close(&msg);
+  if (rc != 0) perror(__FUNCTION__);
+
+  ep->tx = NULL;
+  ep->tx_size = 0;
+  ep->tx_parts = 0;
+
+  return rc;
+}
+
+
+int send_flush(session *s)
+{
+  int rc = 0;
+  unsigned int role_idx;
+  struct role_endpoint *ep;
+
+  for (role_idx=0; role_idx<s->nrole; ++role_idx) {
+    if (s->roles[role_idx]->type != SESSION_ROLE_P2P) continue;
+    ep = s->roles[role_idx]->p2p;
+    if (s->coalesce) rc |= _batch_flush(ep);
+    if (ep->tp->flush != NULL) rc |= ep->tp->flush(ep);
+  }
+
+  return rc;
+}
+
+
+int send_token(role *r)
 {
   int rc = 0;
+  struct role_endpoint *ep;
+  zmq_msg_t msg;
+  unsigned int key = sc_label_hash(TOKEN_LABEL);
+
+  if (r->type != SESSION_ROLE_P2P) {
+    fprintf(stderr, "%s: Cannot send a token to non point-to-point role\n", __FUNCTION__);
+    return -1;
+  }
+  ep = r->p2p;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " --> %s(%s) .\n", __FUNCTION__, ep->name);
+#endif
+
+  // A frame of its own (never batched) after the messages sent before.
+  request_issue_pending(r->s, ep, SESSION_REQ_SEND);
+  if (r->s->coalesce) rc |= _batch_flush(ep);
+  zmq_msg_init_size(&msg, sizeof(key));
+  memcpy(zmq_msg_data(&msg), &key, sizeof(key));
+  rc |= ep->tp->send(ep, &msg, ZMQ_SNDMORE);
+  zmq_msg_close(&msg);
+  zmq_msg_init_size(&msg, 0);
+  rc |= ep->tp->send(ep, &msg, 0);
+  zmq_msg_close(&msg);
+
+  if (rc != 0) perror(__FUNCTION__);
+
+  return rc;
+}
+
+
+int send_int_iov_key(const msg_iov iov[], int iovcnt, role *r, const unsigned int *key)
+{
+  zmq_msg_t msg;
+  size_t size = 0;
+  size_t hdr_size = (key != NULL) ? sizeof(*key) : 0;
+  char *pos;
   int i;
-  role *r;
-  va_list roles;
 
 #ifdef __DEBUG__
-  fprintf(stderr, " --> %s(%d)@%d ", __FUNCTION__, val, nr_of_roles);
+  fprintf(stderr, " --> %s(%d segments) ", __FUNCTION__, iovcnt);
+  if (key != NULL) fprintf(stderr, "{label key: %u}", *key);
 #endif
-  va_start(roles, nr_of_roles);
+
+  if (_batched(r)) {
+    int rc = 0;
+    struct role_endpoint **eps = (r->type == SESSION_ROLE_P2P) ? &r->p2p : r->grp->endpoints;
+    int neps = (r->type == SESSION_ROLE_P2P) ? 1 : r->grp->nendpoint;
+    for (i=0; i<neps; ++i) {
+      request_issue_pending(r->s, eps[i], SESSION_REQ_SEND);
+      _batch_append(eps[i], key, iov, iovcnt);
+      // Only hold back parts to roles the protocol sends runs of messages to.
+      if (!eps[i]->tx_hold || eps[i]->tx_size >= BATCH_MAX) {
+        rc |= _batch_flush(eps[i]);
+      }
+    }
+#ifdef __DEBUG__
+    fprintf(stderr, "(coalesced) .\n");
+#endif
+    return rc;
+  }
+
+  for (i=0; i<iovcnt; ++i) {
+    size += sizeof(int) * iov[i].count;
+  }
+
+  // Labelled messages are a single frame: label key followed by payload.
+  char *buf = (char *)sc_pool_alloc(hdr_size + size);
+  if (key != NULL) {
+    memcpy(buf, key, hdr_size);
+  }
+  pos = buf + hdr_size;
+  for (i=0; i<iovcnt; ++i) {
+    memcpy(pos, iov[i].arr, sizeof(int) * iov[i].count);
+    pos += sizeof(int) * iov[i].count;
+  }
+
+  zmq_msg_init_data(&msg, buf, hdr_size + size, sc_pool_free_fn, NULL);
+  return _send_msg(&msg, r, NULL);
+}
+
+
+int send_int_iov(const msg_iov iov[], int iovcnt, role *r, const char *label)
+{
+  unsigned int key;
+
+  if (label == NULL) {
+    return send_int_iov_key(iov, iovcnt, r, NULL);
+  }
+
+#ifdef __DEBUG__
+  fprintf(stderr, "{label: %s}", label);
+#endif
+  key = sc_label_hash(label);
+  return send_int_iov_key(iov, iovcnt, r, &key);
+}
+
+
+int send_int_array(const int arr[], size_t count, role *r, const char *label)
+{
+  msg_iov iov = { (int *)arr, count };
+  return send_int_iov(&iov, 1, r, label);
+}
+
+
+int send_int_array_nocopy(int *arr, size_t count, role *r, const char *label,
+                          sc_free_fn *ffn, void *hint)
+{
+  zmq_msg_t msg;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " --> %s ", __FUNCTION__);
+#endif
+
+  if (_batched(r)) { // Batched, copy instead.
+    msg_iov iov = { arr, count };
+    int rc = send_int_iov(&iov, 1, r, label);
+    if (ffn != NULL) {
+      ffn(arr, hint);
+    } else {
+      _dealloc(arr, hint);
+    }
+    return rc;
+  }
+
+  // Hand arr straight to ZeroMQ, ffn is called when the message is released.
+  zmq_msg_init_data(&msg, arr, sizeof(int) * count, ffn != NULL ? ffn : _dealloc, hint);
+  return _send_msg(&msg, r, label);
+}
+
+
+int send_int_typed(const int *arr, const datatype *type, role *r, const char *label)
+{
+  zmq_msg_t msg;
+  unsigned int key;
+  size_t hdr_size = (label != NULL) ? sizeof(key) : 0;
+  char *buf;
+
+  if (type->kind == SC_DTYPE_CONTIG) {
+    return send_int_array(arr + type->offset, type->size, r, label);
+  }
+
+#ifdef __DEBUG__
+  fprintf(stderr, " --> %s(%zu elements) ", __FUNCTION__, type->size);
+#endif
+
+  if (_batched(r)) { // Packed into the batch.
+    int rc;
+    msg_iov iov = { (int *)sc_pool_alloc(sizeof(int) * type->size), type->size };
+    datatype_pack(arr, type, iov.arr);
+    rc = send_int_iov(&iov, 1, r, label);
+    sc_pool_free(iov.arr);
+    return rc;
+  }
+
+  // Pack behind the label key, same frame as send_int_array.
+  buf = (char *)sc_pool_alloc(hdr_size + sizeof(int) * type->size);
+  if (label != NULL) {
+    key = sc_label_hash(label);
+    memcpy(buf, &key, hdr_size);
+  }
+  datatype_pack(arr, type, (int *)(buf + hdr_size));
+
+  zmq_msg_init_data(&msg, buf, hdr_size + sizeof(int) * type->size, sc_pool_free_fn, NULL);
+  return _send_msg(&msg, r, NULL);
+}
+
+
+int msend_int_array(const int arr[], size_t count, role *roles[], int nr_of_roles, const char *label)
+{
+  int rc = 0;
+  int i;
+  zmq_msg_t msg, copy;
+  int serialised = 0;
+  unsigned int key;
+  size_t hdr_size = (label != NULL) ? sizeof(key) : 0;
+  msg_iov iov = { (int *)arr, count };
+  char *buf;
+
+#ifdef __DEBUG__
+  fprintf(stderr, " --> %s(%zu elements)@%d ", __FUNCTION__, count, nr_of_roles);
+  if (label != NULL) fprintf(stderr, "{label: %s}", label);
+#endif
+
+  if (label != NULL) key = sc_label_hash(label);
+
   for (i=0; i<nr_of_roles; i++) {
-    r = va_arg(roles, role *);
+    if (_batched(roles[i])) { // Goes into the batch.
+      rc |= send_int_iov_key(&iov, 1, roles[i], (label != NULL) ? &key : NULL);
+      continue;
+    }
+
+    if (!serialised) { // Same frame as send_int_array, built once.
+      buf = (char *)sc_pool_alloc(hdr_size + sizeof(int) * count);
+      if (label != NULL) memcpy(buf, &key, hdr_size);
+      memcpy(buf + hdr_size, arr, sizeof(int) * count);
+      zmq_msg_init_data(&msg, buf, hdr_size + sizeof(int) * count, sc_pool_free_fn, NULL);
+      serialised = 1;
+    }
 
 #ifdef __DEBUG__
     fprintf(stderr, "   +");
 #endif
-    rc |= send_int(val, r, NULL);
-    if (rc != 0) perror(__FUNCTION__);
+    // Every destination is sent a reference to the same buffer.
+    zmq_msg_init(&copy);
+    zmq_msg_copy(&copy, &msg);
+    rc |= _send_msg(&copy, roles[i], NULL);
   }
-  va_end(roles);
+
+  if (serialised) zmq_msg_close(&msg);
 
 #ifdef __DEBUG__
   fprintf(stderr, ".\n");
@@ -122,56 +464,403 @@ int vsend_int(int val, int nr_of_roles, ...)
 }
 
 
-int probe_label(char **label, role *r)
+int vsend_int(int val, int nr_of_roles, ...)
+{
+  int i;
+  role *roles[nr_of_roles > 0 ? nr_of_roles : 1];
+  va_list ap;
+
+  va_start(ap, nr_of_roles);
+  for (i=0; i<nr_of_roles; i++) {
+    roles[i] = va_arg(ap, role *);
+  }
+  va_end(ap);
+
+  return msend_int_array(&val, 1, roles, nr_of_roles, NULL);
+}
+
+
+/**
+ * \brief Helper function to find the sub-group member to receive from.
+ *
+ * A member with a message held back is taken first,
+ * otherwise the first member a message arrives from.
+ */
+static struct role_endpoint *_member_endpoint(role *r)
+{
+  int rc;
+  int endpoint_idx;
+  int n = r->grp->nendpoint;
+  short events[n > 0 ? n : 1], revents[n > 0 ? n : 1];
+
+  if (n == 0) return NULL;
+  for (endpoint_idx=0; endpoint_idx<n; ++endpoint_idx) {
+    events[endpoint_idx] = ZMQ_POLLIN;
+  }
+
+  rc = transport_poll(r->grp->endpoints, events, revents, n, 0);
+  if (rc == 0) {
+    send_flush(r->s); // About to block, send out everything held back.
+    rc = transport_poll(r->grp->endpoints, events, revents, n, -1);
+  }
+  if (rc < 0) return NULL;
+  for (endpoint_idx=0; endpoint_idx<n; ++endpoint_idx) {
+    if (revents[endpoint_idx] & ZMQ_POLLIN) return r->grp->endpoints[endpoint_idx];
+  }
+
+  return NULL;
+}
+
+
+/**
+ * \brief Helper function to find the receiving endpoint of a role.
+ *
+ */
+static struct role_endpoint *_in_endpoint(role *r)
+{
+  switch (r->type) {
+    case SESSION_ROLE_P2P:
+      return r->p2p;
+    case SESSION_ROLE_GRP:
+#ifdef __DEBUG__
+      fprintf(stderr, "<- %s(%d endpoints) ", r->grp->name, r->grp->nendpoint);
+#endif
+      if (r->grp->in == NULL) return _member_endpoint(r); // Sub-group.
+      return r->grp->in;
+    default:
+      fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
+  }
+  return NULL;
+}
+
+
+/**
+ * \brief Helper function to receive a frame from the transport,
+ * holding back barrier tokens.
+ *
+ * A token is the reserved label key as a frame of its own followed
+ * by an empty frame; batches and unlabelled messages are single
+ * frames, so data never looks like one.
+ *
+ * \returns 1 if a token was received (counted on the endpoint),
+ *          0 if a data frame was received into msg, -1 on error.
+ */
+static int _recv_wire(struct role_endpoint *ep, zmq_msg_t *msg)
+{
+  unsigned int key;
+
+  if (ep->tp->recv(ep, msg, 0) != 0) return -1;
+  if (zmq_msg_size(msg) != sizeof(key) || !ep->tp->more(ep)) return 0;
+  memcpy(&key, zmq_msg_data(msg), sizeof(key));
+  if (key != sc_label_hash(TOKEN_LABEL)) return 0; // Label of a message.
+
+  if (ep->tp->recv(ep, msg, 0) != 0) return -1; // Empty frame.
+  ep->rx_tokens++;
+  return 1;
+}
+
+
+/**
+ * \brief Helper function to hold back a frame received ahead of a token.
+ *
+ */
+static void _hold(struct role_endpoint *ep, zmq_msg_t *msg, int more)
+{
+  zmq_msg_t *held;
+
+  if (ep->rx_nheld == ep->rx_maxheld) {
+    ep->rx_maxheld = (ep->rx_maxheld == 0) ? HELD_FRAMES : ep->rx_maxheld * 2;
+    ep->rx_held = realloc(ep->rx_held, sizeof(zmq_msg_t) * ep->rx_maxheld);
+    ep->rx_held_more = (int *)realloc(ep->rx_held_more, sizeof(int) * ep->rx_maxheld);
+  }
+
+  held = (zmq_msg_t *)ep->rx_held + ep->rx_nheld;
+  zmq_msg_init(held);
+  zmq_msg_move(held, msg);
+  ep->rx_held_more[ep->rx_nheld] = more;
+  ep->rx_nheld++;
+}
+
+
+/**
+ * \brief Helper function to receive the next frame of an endpoint.
+ *
+ * Frames held back by recv_token() are taken first (in order).
+ *
+ * \returns 1 if a token was received (counted on the endpoint),
+ *          0 if a data frame was received into msg, -1 on error.
+ */
+static int _recv_frame(struct role_endpoint *ep, zmq_msg_t *msg)
+{
+  zmq_msg_t *held = (zmq_msg_t *)ep->rx_held;
+
+  if (ep->rx_nheld == 0) {
+    ep->rx_taken = 0;
+    return _recv_wire(ep, msg);
+  }
+
+  zmq_msg_move(msg, &held[0]);
+  zmq_msg_close(&held[0]);
+  ep->rx_taken = 1;
+  ep->rx_more = ep->rx_held_more[0];
+
+  // zmq_msg_t is moved by copying (as zmq_msg_move does).
+  ep->rx_nheld--;
+  memmove(held, held + 1, sizeof(zmq_msg_t) * ep->rx_nheld);
+  memmove(ep->rx_held_more, ep->rx_held_more + 1, sizeof(int) * ep->rx_nheld);
+
+  return 0;
+}
+
+
+/**
+ * \brief Helper function to check if the last frame received on
+ * an endpoint is followed by another (ZMQ_RCVMORE).
+ */
+static inline int _more(struct role_endpoint *ep)
+{
+  return ep->rx_taken ? ep->rx_more : ep->tp->more(ep);
+}
+
+
+/**
+ * \brief Helper function to hold back a received frame on an endpoint.
+ *
+ * In coalescing mode a frame is a batch of parts, otherwise
+ * the whole frame is one part.
+ */
+static void _open_frame(struct role_endpoint *ep, int batched)
+{
+  if (batched) {
+    memcpy(&ep->rx_parts, zmq_msg_data((zmq_msg_t *)ep->rx), sizeof(ep->rx_parts));
+    ep->rx_offset = sizeof(ep->rx_parts);
+  } else {
+    ep->rx_parts = 1;
+    ep->rx_offset = 0;
+  }
+}
+
+
+/**
+ * \brief Helper function to open the next message part on an endpoint.
+ *
+ * Receives a new frame if none is held back. In coalescing mode a
+ * frame is a batch of parts, otherwise the whole frame is one part.
+ * The open part is described by rx_offset and rx_size.
+ */
+static int _open_part(struct role_endpoint *ep, session *s, int batched)
 {
   int rc = 0;
+  zmq_msg_t *rx;
+  unsigned int part_size;
+
+  if (ep->rx_pending) return 0;
+
+  if (ep->rx == NULL) {
+    ep->rx = malloc(sizeof(zmq_msg_t));
+    zmq_msg_init((zmq_msg_t *)ep->rx);
+  }
+  rx = (zmq_msg_t *)ep->rx;
+
+  if (ep->rx_parts == 0) {
+    send_flush(s); // About to block, send out everything held back.
+    while ((rc = _recv_frame(ep, rx)) == 1); // Tokens are left to recv_token().
+    if (rc != 0) return rc;
+    _open_frame(ep, batched);
+  }
+
+  if (batched) {
+    memcpy(&part_size, (char *)zmq_msg_data(rx) + ep->rx_offset, sizeof(part_size));
+    ep->rx_offset += sizeof(part_size);
+    ep->rx_size = part_size;
+  } else {
+    ep->rx_size = zmq_msg_size(rx) - ep->rx_offset;
+  }
+  ep->rx_parts--;
+  ep->rx_pending = 1;
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to receive a shared memory broadcast.
+ *
+ * An empty frame followed by another frame is a broadcast descriptor,
+ * msg is replaced by the payload in shared memory.
+ */
+static int _recv_shm(zmq_msg_t *msg, size_t *size, struct role_endpoint *ep, session *s)
+{
+  int rc = 0;
+
+  if (!_more(ep)) return rc;
+
+  zmq_msg_close(msg);
+  zmq_msg_init(msg);
+  if ((rc = ep->tp->recv(ep, msg, 0)) != 0) return rc;
+  rc = shm_attach(msg, s);
+  *size = zmq_msg_size(msg);
+
+  return rc;
+}
+
+
+/**
+ * \brief Helper function to receive a message from a role.
+ *
+ * A message part held back (by probe_label_id() or in a coalesced
+ * batch) is returned first. msg must be initialised by the caller,
+ * offset and size are set to the payload in msg.
+ */
+static int _recv_msg(zmq_msg_t *msg, size_t *offset, size_t *size, role *r)
+{
+  int rc = 0;
+  struct role_endpoint *ep = _in_endpoint(r);
+  int batched = _batched(r);
+
+  *offset = 0;
+  *size = 0;
+  if (ep == NULL) return -1;
+  request_issue_pending(r->s, ep, SESSION_REQ_RECV); // Earlier non-blocking receives first.
+
+  if (!ep->rx_pending && ep->rx_parts == 0 && !batched) {
+    send_flush(r->s); // About to block, send out everything held back.
+    while ((rc = _recv_frame(ep, msg)) == 1); // Tokens are left to recv_token().
+    *size = zmq_msg_size(msg);
+    if (rc == 0 && *size == 0 && r->type == SESSION_ROLE_GRP) {
+      rc = _recv_shm(msg, size, ep, r->s);
+    }
+    return rc;
+  }
+
+  if ((rc = _open_part(ep, r->s, batched)) != 0) return rc;
+
+  // Share the frame while other parts remain, hand it over otherwise.
+  if (ep->rx_parts > 0) {
+    rc = zmq_msg_copy(msg, (zmq_msg_t *)ep->rx);
+  } else {
+    rc = zmq_msg_move(msg, (zmq_msg_t *)ep->rx);
+  }
+  *offset = ep->rx_offset;
+  *size = ep->rx_size;
+  ep->rx_offset += ep->rx_size;
+  ep->rx_pending = 0;
+
+  return rc;
+}
+
+
+int recv_token(role *r)
+{
+  int rc = 0;
+  struct role_endpoint *ep;
   zmq_msg_t msg;
-  size_t size = -1;
 
-  // Label detection.
-  int64_t more;
-  size_t more_size = sizeof(more);
+  if (r->type != SESSION_ROLE_P2P) {
+    fprintf(stderr, "%s: Cannot receive a token from non point-to-point role\n", __FUNCTION__);
+    return -1;
+  }
+  ep = r->p2p;
 
 #ifdef __DEBUG__
-  fprintf(stderr, " <-- %s() ", __FUNCTION__);
+  fprintf(stderr, " <-- %s(%s) .\n", __FUNCTION__, ep->name);
 #endif
 
-  zmq_msg_init(&msg);
-  switch (r->type) {
-    case SESSION_ROLE_P2P:
-      rc = zmq_recv(r->p2p->ptr, &msg, 0);
-      assert(rc == 0);
-      rc = zmq_getsockopt(r->p2p->ptr, ZMQ_RCVMORE, &more, &more_size);
-      assert(rc == 0);
-      break;
-    case SESSION_ROLE_GRP:
+  while (ep->rx_tokens == 0) {
+    send_flush(r->s); // About to block, send out everything held back.
+    zmq_msg_init(&msg);
+    if ((rc = _recv_wire(ep, &msg)) == 0) {
+      // A frame sent before the token, held back for the receives that follow.
+      _hold(ep, &msg, ep->tp->more(ep));
+    }
+    zmq_msg_close(&msg);
+    if (rc < 0) {
+      perror(__FUNCTION__);
+      return rc;
+    }
+  }
+  ep->rx_tokens--;
+
+  return 0;
+}
+
+
+int probe_label_id(int *label_id, role *r)
+{
+  int rc = 0;
+  struct role_endpoint *ep = _in_endpoint(r);
+  int batched = _batched(r);
+  zmq_msg_t *msg;
+  unsigned int key = 0;
+  unsigned int label_idx;
+
+  // Label detection.
+  int more = 0;
+
 #ifdef __DEBUG__
-      fprintf(stderr, "recv_label <- %s (%d endpoints) ", r->grp->name, r->grp->nendpoint);
+  fprintf(stderr, " <-- %s() ", __FUNCTION__);
 #endif
-      rc = zmq_recv(r->grp->in->ptr, &msg, 0);
-      assert(rc == 0);
-      rc = zmq_getsockopt(r->grp->in->ptr, ZMQ_RCVMORE, &more, &more_size);
-      assert(rc == 0);
+
+  *label_id = -1;
+  if (ep == NULL) return -1;
+  request_issue_pending(r->s, ep, SESSION_REQ_RECV);
+
+  assert(!ep->rx_pending); // Previous labelled message not consumed
+  rc = _open_part(ep, r->s, batched);
+  assert(rc == 0);
+  msg = (zmq_msg_t *)ep->rx;
+  assert(ep->rx_size >= sizeof(key));
+  memcpy(&key, (char *)zmq_msg_data(msg) + ep->rx_offset, sizeof(key));
+  ep->rx_offset += sizeof(key);
+  ep->rx_size -= sizeof(key);
+
+  // Label key is either followed by the payload in the same frame
+  // (send_int_array) or sent as a frame of its own (send_int_array_nocopy).
+  if (!batched && ep->rx_size == 0) {
+    more = _more(ep);
+  }
+  if (more) {
+    zmq_msg_close(msg);
+    zmq_msg_init(msg);
+    ep->rx_pending = 0;
+  }
+
+  for (label_idx=0; label_idx<r->s->nlabel; ++label_idx) {
+    if (r->s->label_keys[label_idx] == key) {
+      *label_id = label_idx;
       break;
-    default:
-        fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
+    }
   }
-  size = zmq_msg_size(&msg);
-  *label = (char *)calloc(sizeof(char), size+1);
-  memcpy(*label, (char *)zmq_msg_data(&msg), size);
-  zmq_msg_close(&msg);
 
-  assert(more == 1); // Label has to be followed by a message
+  if (*label_id == -1) {
+    fprintf(stderr, "%s: Label (key %u) not in local protocol\n", __FUNCTION__, key);
+  }
 
   if (rc != 0) perror(__FUNCTION__);
 
 #ifdef __DEBUG__
-  fprintf(stderr, "[%s] .\n", *label);
+  fprintf(stderr, "[%d] .\n", *label_id);
 #endif
   return rc;
 }
 
 
+int probe_label(char **label, role *r)
+{
+  int label_id;
+  int rc = probe_label_id(&label_id, r);
+
+  if (label_id >= 0) {
+    *label = (char *)calloc(sizeof(char), strlen(r->s->labels[label_id])+1);
+    strcpy(*label, r->s->labels[label_id]);
+  } else {
+    *label = (char *)calloc(sizeof(char), 1);
+  }
+
+  return rc;
+}
+
+
 inline int has_label(char *label, const char *_label)
 {
   return (strcmp(label, _label) == 0);
@@ -189,6 +878,7 @@ int recv_int_array(int *arr, size_t *count, role *r)
 {
   int rc = 0;
   zmq_msg_t msg;
+  size_t offset = 0;
   size_t size = -1;
 
 #ifdef __DEBUG__
@@ -196,27 +886,14 @@ int recv_int_array(int *arr, size_t *count, role *r)
 #endif
 
   zmq_msg_init(&msg);
-  switch (r->type) {
-    case SESSION_ROLE_P2P:
-      rc = zmq_recv(r->p2p->ptr, &msg, 0);
-      break;
-    case SESSION_ROLE_GRP:
-#ifdef __DEBUG__
-      fprintf(stderr, "bcast <- %s(%d endpoints) ", r->grp->name, r->grp->nendpoint);
-#endif
-      rc = zmq_recv(r->grp->in->ptr, &msg, 0);
-      break;
-    default:
-        fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
-  }
-  size = zmq_msg_size(&msg);
+  rc = _recv_msg(&msg, &offset, &size, r);
   if (*count * sizeof(int) >= size) {
-    memcpy(arr, (int *)zmq_msg_data(&msg), size);
+    memcpy(arr, (char *)zmq_msg_data(&msg) + offset, size);
     if (size % sizeof(int) == 0) {
       *count = size / sizeof(int);
     }
   } else {
-    memcpy(arr, (int *)zmq_msg_data(&msg), *count * sizeof(int));
+    memcpy(arr, (char *)zmq_msg_data(&msg) + offset, *count * sizeof(int));
     fprintf(stderr,
       "%s: Received data (%zu bytes) > memory size (%zu), data truncated\n",
       __FUNCTION__, size, *count * sizeof(int));
@@ -233,99 +910,162 @@ int recv_int_array(int *arr, size_t *count, role *r)
 }
 
 
-inline int bcast_int(int val, session *s)
+int recv_int_iov(msg_iov iov[], int iovcnt, role *r)
 {
-  return send_int_array(&val, 1, s->r(s, "_Others"), NULL);
-}
+  int rc = 0;
+  zmq_msg_t msg;
+  size_t offset = 0;
+  size_t size;
+  size_t seg_size;
+  int i;
 
+#ifdef __DEBUG__
+  fprintf(stderr, " <-- %s(%d segments) ", __FUNCTION__, iovcnt);
+#endif
 
-inline int bcast_int_array(const int arr[], size_t count, session *s)
-{
-  return send_int_array(arr, count, s->r(s, "_Others"), NULL);
-}
+  zmq_msg_init(&msg);
+  rc = _recv_msg(&msg, &offset, &size, r);
+
+  for (i=0; i<iovcnt; ++i) {
+    seg_size = sizeof(int) * iov[i].count;
+    if (seg_size > size) seg_size = size - (size % sizeof(int));
+    memcpy(iov[i].arr, (char *)zmq_msg_data(&msg) + offset, seg_size);
+    iov[i].count = seg_size / sizeof(int);
+    offset += seg_size;
+    size -= seg_size;
+  }
+  if (size > 0) {
+    fprintf(stderr,
+      "%s: Received data exceeds segments by %zu bytes, data truncated\n",
+      __FUNCTION__, size);
+  }
+  zmq_msg_close(&msg);
 
+  if (rc != 0) perror(__FUNCTION__);
 
-inline int brecv_int(int *dst, session *s)
-{
-  size_t count;
-  return recv_int_array(dst, &count, s->r(s, "_Others"));
+#ifdef __DEBUG__
+  fprintf(stderr, ".\n");
+#endif
+
+  return rc;
 }
 
 
-inline int brecv_int_array(int *arr, size_t *count, session *s)
+int recv_int_array_labelled(int *label_id, int *arr, size_t *count, role *r)
 {
-  return recv_int_array(arr, count, s->r(s, "_Others"));
+  int rc = probe_label_id(label_id, r);
+  if (rc != 0) return rc;
+  return recv_int_array(arr, count, r);
 }
 
 
-int barrier(role *grp_role, char *at_rolename)
+int recv_int_typed(int *arr, const datatype *type, role *r)
 {
-  if (grp_role->type != SESSION_ROLE_GRP) {
-    fprintf(stderr, "Error: cannot perform barrier synchronisation with non group role!\n");
-    return -1;
+  int rc = 0;
+  msg_view view;
+  size_t count = type->size;
+
+  if (type->kind == SC_DTYPE_CONTIG) {
+    return recv_int_array(arr + type->offset, &count, r);
+  }
+
+  // Unpack straight out of the received message.
+  if ((rc = recv_int_array_view(&view, r)) != 0) return rc;
+  if (view.count < type->size) {
+    fprintf(stderr, "%s: Received %zu elements < datatype size (%zu)\n",
+      __FUNCTION__, view.count, type->size);
+    rc = -1;
+  } else {
+    if (view.count > type->size) {
+      fprintf(stderr, "%s: Received %zu elements > datatype size (%zu), data truncated\n",
+        __FUNCTION__, view.count, type->size);
+    }
+    datatype_unpack(view.arr, type, arr);
   }
+  release_view(&view);
 
+  return rc;
+}
+
+
+int recv_int_array_view(msg_view *view, role *r)
+{
   int rc = 0;
-  zmq_msg_t msg;
-  int i;
+  zmq_msg_t *msg = (zmq_msg_t *)sc_pool_alloc(sizeof(zmq_msg_t));
+  size_t offset = 0;
+  size_t size;
 
-  if (strcmp(grp_role->s->name, at_rolename) == 0) { // Master role
+#ifdef __DEBUG__
+  fprintf(stderr, " <-- %s() ", __FUNCTION__);
+#endif
 
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_UNSUBSCRIBE, "", 0);
-    if (rc != 0) perror(__FUNCTION__);
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_SUBSCRIBE, "S1", 2);
-    if (rc != 0) perror(__FUNCTION__);
+  zmq_msg_init(msg);
+  rc = _recv_msg(msg, &offset, &size, r);
 
-    // Wait for S1 (Phase 1) messages.
-    for (i=0; i<grp_role->grp->nendpoint; ++i) {
-      zmq_msg_init(&msg);
-      rc |= zmq_recv(grp_role->grp->in->ptr, &msg, 0);
-      if (rc != 0) perror(__FUNCTION__);
-      zmq_msg_close (&msg);
-    }
+  view->msg = msg;
+  view->count = size / sizeof(int);
+  view->arr = (const int *)((char *)zmq_msg_data(msg) + offset);
 
-    // Reset filters.
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_UNSUBSCRIBE, "S1", 2);
-    if (rc != 0) perror(__FUNCTION__);
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_SUBSCRIBE, "", 0);
-    if (rc != 0) perror(__FUNCTION__);
+  // Very small messages are stored inside zmq_msg_t and may be misaligned.
+  if (((uintptr_t)view->arr % sizeof(int)) != 0 && size <= sizeof(view->vsm)) {
+    memcpy(view->vsm, view->arr, size);
+    view->arr = view->vsm;
+  }
 
-    zmq_msg_init_size(&msg, 2);
-    memcpy(zmq_msg_data(&msg), "S2", 2);
-    rc |= zmq_send(grp_role->grp->out->ptr, &msg, 0);
-    if (rc != 0) perror(__FUNCTION__);
-    zmq_msg_close(&msg);
+  if (rc != 0) perror(__FUNCTION__);
 
-    // Synchronised.
+#ifdef __DEBUG__
+  fprintf(stderr, "[%zu elements] .\n", view->count);
+#endif
 
-  } else { // Slave role
+  return rc;
+}
 
-    // Send S1 (Phase 1) messages.
-    zmq_msg_init_size(&msg, 2);
-    memcpy(zmq_msg_data(&msg), "S1", 2);
-    rc |= zmq_send(grp_role->grp->out->ptr, &msg, 0);
-    if (rc != 0) perror(__FUNCTION__);
-    zmq_msg_close(&msg);
 
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_UNSUBSCRIBE, "", 0);
-    if (rc != 0) perror(__FUNCTION__);
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_SUBSCRIBE, "S2", 2);
-    if (rc != 0) perror(__FUNCTION__);
+void release_view(msg_view *view)
+{
+  if (view->msg != NULL) {
+    zmq_msg_close((zmq_msg_t *)view->msg);
+    sc_pool_free(view->msg);
+  }
+  view->msg = NULL;
+  view->arr = NULL;
+  view->count = 0;
+}
+
+
+inline int bcast_int(int val, session *s)
+{
+  return send_int_array(&val, 1, s->r(s, "_Others"), NULL);
+}
 
-    // Wait for S2 (Phase 2) messages.
-    zmq_msg_init(&msg);
-    rc |= zmq_recv(grp_role->grp->in->ptr, &msg, 0);
-    if (rc != 0) perror(__FUNCTION__);
-    zmq_msg_close(&msg);
 
-    // Reset filters.
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_UNSUBSCRIBE, "S2", 2);
-    if (rc != 0) perror(__FUNCTION__);
-    rc |= zmq_setsockopt(grp_role->grp->in->ptr, ZMQ_SUBSCRIBE, "", 0);
-    if (rc != 0) perror(__FUNCTION__);
+inline int bcast_int_array(const int arr[], size_t count, session *s)
+{
+  role *grp_role = s->r(s, "_Others");
 
-    // Synchronised.
+  // Co-located receivers read a single copy in shared memory.
+  if (shm_bcast_eligible(grp_role, count) && shm_bcast_int_array(arr, count, grp_role) == 0) {
+    return 0;
   }
+  return send_int_array(arr, count, grp_role, NULL);
+}
 
-  return rc;
+
+inline int brecv_int(int *dst, session *s)
+{
+  size_t count;
+  return recv_int_array(dst, &count, s->r(s, "_Others"));
+}
+
+
+inline int brecv_int_array(int *arr, size_t *count, session *s)
+{
+  return recv_int_array(arr, count, s->r(s, "_Others"));
+}
+
+
+inline int brecv_int_array_view(msg_view *view, session *s)
+{
+  return recv_int_array_view(view, s->r(s, "_Others"));
 }
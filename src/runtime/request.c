@@ -0,0 +1,480 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * non-blocking communication module.
+ */
+
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zmq.h>
+
+#include "sc/pool.h"
+#include "sc/primitives.h"
+#include "sc/request.h"
+#include "sc/transport.h"
+#include "sc/utils.h"
+
+#define REQUEST_POLL_TIMEOUT 1000 // Microseconds.
+
+
+/**
+ * \brief Helper function to mark a send request as complete.
+ *
+ * Called (possibly from a ZeroMQ I/O thread) when
+ * the message no longer needs the user buffer.
+ */
+static void _send_done(void *data, void *hint)
+{
+  request *req = (request *)hint;
+  __sync_synchronize();
+  req->complete = 1;
+}
+
+
+/**
+ * \brief Helper function to find the endpoint a request uses.
+ *
+ */
+static struct role_endpoint *_endpoint(role *r, int type)
+{
+  switch (r->type) {
+    case SESSION_ROLE_P2P:
+      return r->p2p;
+    case SESSION_ROLE_GRP:
+      if (r->grp->in == NULL) {
+        fprintf(stderr, "%s: Non-blocking requests on sub-group %s not supported\n", __FUNCTION__, r->grp->name);
+        return NULL;
+      }
+      return (type == SESSION_REQ_SEND) ? r->grp->out : r->grp->in;
+    default:
+      fprintf(stderr, "%s: Unknown endpoint type: %d\n", __FUNCTION__, r->type);
+  }
+  return NULL;
+}
+
+
+/**
+ * \brief Helper function to create a request.
+ *
+ */
+static request *_new(int type, role *r, const char *label)
+{
+  request *req;
+  struct role_endpoint *ep = _endpoint(r, type);
+
+  if (ep == NULL) return NULL;
+
+  req = (request *)sc_pool_alloc(sizeof(request));
+  req->type = type;
+  req->r = r;
+  req->ep = ep;
+  req->labelled = (label != NULL);
+  req->key = (label != NULL) ? sc_label_hash(label) : 0;
+  req->arr = NULL;
+  req->count = 0;
+  req->countp = NULL;
+  req->persistent = 0;
+  req->active = 0;
+  req->issued = 0;
+  req->complete = 0;
+  req->rc = 0;
+  req->next = NULL;
+
+  return req;
+}
+
+
+/**
+ * \brief Helper function to queue a request on the
+ * session's outstanding request list.
+ */
+static void _queue(request *req)
+{
+  request **tail;
+
+  req->active = 1;
+  req->issued = 0;
+  req->complete = 0;
+  req->rc = 0;
+  req->next = NULL;
+
+  for (tail = &req->r->s->reqs; *tail != NULL; tail = &(*tail)->next);
+  *tail = req;
+}
+
+
+/**
+ * \brief Helper function to check if a request has to wait
+ * for an earlier request on the same endpoint.
+ */
+static int _blocked(const session *s, const request *req)
+{
+  const request *it;
+  for (it = s->reqs; it != req; it = it->next) {
+    if (it->ep == req->ep && it->type == req->type && !it->issued) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+/**
+ * \brief Helper function to check if an endpoint can
+ * send/receive without blocking.
+ */
+static int _ready(struct role_endpoint *ep, short events)
+{
+  short revents;
+
+  return transport_poll(&ep, &events, &revents, 1, 0) > 0;
+}
+
+
+/**
+ * \brief Helper function to carry out a request on a ready endpoint.
+ *
+ */
+static void _issue(request *req)
+{
+  zmq_msg_t msg;
+
+  req->issued = 1;
+  req->r->s->issuing = req; // Primitives called below are in order already.
+  switch (req->type) {
+    case SESSION_REQ_SEND:
+      req->rc = 0;
+      if (req->r->type == SESSION_ROLE_P2P && req->r->s->coalesce) { // Copied into batch.
+        msg_iov iov = { req->arr, req->count };
+        req->rc = send_int_iov_key(&iov, 1, req->r, req->labelled ? &req->key : NULL);
+        req->complete = 1;
+        break;
+      }
+      if (req->labelled) { // Label key as a separate frame (payload is not copied).
+        zmq_msg_init_size(&msg, sizeof(req->key));
+        memcpy(zmq_msg_data(&msg), &req->key, sizeof(req->key));
+        req->rc |= req->ep->tp->send(req->ep, &msg, ZMQ_SNDMORE);
+        zmq_msg_close(&msg);
+      }
+      // Completes when ZeroMQ releases the (uncopied) user buffer.
+      zmq_msg_init_data(&msg, req->arr, sizeof(int) * req->count, _send_done, req);
+      req->rc |= req->ep->tp->send(req->ep, &msg, 0);
+      zmq_msg_close(&msg);
+      if (req->rc != 0) perror(__FUNCTION__);
+      break;
+    case SESSION_REQ_RECV:
+      req->rc = recv_int_array(req->arr, req->countp, req->r);
+      req->complete = 1;
+      break;
+  }
+  req->r->s->issuing = NULL;
+}
+
+
+void request_issue_pending(session *s, struct role_endpoint *ep, int type)
+{
+  request *req;
+
+  if (s->issuing != NULL) return;
+
+  // Transports queue what they cannot send yet, issuing does not wait.
+  for (req = s->reqs; req != NULL; req = req->next) {
+    if (req->ep == ep && req->type == type && !req->issued) _issue(req);
+  }
+}
+
+
+/**
+ * \brief Helper function to wait for issued sends to complete.
+ *
+ * Transports holding back the messages (or writing them out) are not
+ * ready to send until they are done; ZeroMQ releases the buffers from
+ * its I/O thread, so its endpoints are always ready.
+ */
+static void _wait_sends(session *s)
+{
+  request *req;
+  int n = 0;
+
+  for (req = s->reqs; req != NULL; req = req->next) {
+    if (req->issued && !req->complete && req->type == SESSION_REQ_SEND) n++;
+  }
+
+  struct role_endpoint *eps[n > 0 ? n : 1];
+  short events[n > 0 ? n : 1], revents[n > 0 ? n : 1];
+  n = 0;
+  for (req = s->reqs; req != NULL; req = req->next) {
+    if (req->issued && !req->complete && req->type == SESSION_REQ_SEND) {
+      eps[n] = req->ep;
+      events[n] = ZMQ_POLLOUT;
+      n++;
+    }
+  }
+
+  if (n == 0 || transport_poll(eps, events, revents, n, REQUEST_POLL_TIMEOUT) > 0) {
+    sched_yield(); // Nothing left to wait for on the transports.
+  }
+}
+
+
+/**
+ * \brief Progress engine.
+ *
+ * Issue every outstanding request of a session whose endpoint is
+ * ready. If block is set and nothing could be issued, wait for an
+ * endpoint to become ready (or for a send buffer to be released).
+ */
+static void _progress(session *s, int block)
+{
+  request *req;
+  int nitem = 0;
+  int progressed = 0;
+
+  for (req = s->reqs; req != NULL; req = req->next) {
+    if (req->issued || _blocked(s, req)) continue;
+    if (_ready(req->ep, req->type == SESSION_REQ_SEND ? ZMQ_POLLOUT : ZMQ_POLLIN)) {
+      _issue(req);
+      progressed = 1;
+    } else {
+      nitem++;
+    }
+  }
+
+  if (!block || progressed) return;
+
+  send_flush(s); // About to block, send out everything held back.
+
+  if (nitem == 0) { // Only waiting for issued sends to be released.
+    _wait_sends(s);
+    return;
+  }
+
+  struct role_endpoint *eps[nitem];
+  short events[nitem], revents[nitem];
+  nitem = 0;
+  for (req = s->reqs; req != NULL; req = req->next) {
+    if (req->issued || _blocked(s, req)) continue;
+    eps[nitem] = req->ep;
+    events[nitem] = (req->type == SESSION_REQ_SEND) ? ZMQ_POLLOUT : ZMQ_POLLIN;
+    nitem++;
+  }
+  transport_poll(eps, events, revents, nitem, REQUEST_POLL_TIMEOUT);
+}
+
+
+/**
+ * \brief Helper function to retire a completed request.
+ *
+ * Persistent requests become inactive, others are freed.
+ */
+static int _retire(request **req)
+{
+  request **it;
+  int rc = (*req)->rc;
+
+  for (it = &(*req)->r->s->reqs; *it != NULL; it = &(*it)->next) {
+    if (*it == *req) {
+      *it = (*req)->next;
+      break;
+    }
+  }
+  (*req)->active = 0;
+
+  if (!(*req)->persistent) {
+    sc_pool_free(*req);
+    *req = NULL;
+  }
+
+  return rc;
+}
+
+
+int isend_int(int val, role *r, const char *label, request **req)
+{
+  if ((*req = _new(SESSION_REQ_SEND, r, label)) == NULL) return -1;
+  (*req)->val = val;
+  (*req)->arr = &(*req)->val;
+  (*req)->count = 1;
+  _queue(*req);
+  _progress(r->s, 0);
+  return 0;
+}
+
+
+int isend_int_array(const int arr[], size_t count, role *r, const char *label, request **req)
+{
+  if ((*req = _new(SESSION_REQ_SEND, r, label)) == NULL) return -1;
+  (*req)->arr = (int *)arr;
+  (*req)->count = count;
+  _queue(*req);
+  _progress(r->s, 0);
+  return 0;
+}
+
+
+int irecv_int(int *dst, role *r, request **req)
+{
+  if ((*req = _new(SESSION_REQ_RECV, r, NULL)) == NULL) return -1;
+  (*req)->count = 1;
+  (*req)->arr = dst;
+  (*req)->countp = &(*req)->count;
+  _queue(*req);
+  _progress(r->s, 0);
+  return 0;
+}
+
+
+int irecv_int_array(int *arr, size_t *count, role *r, request **req)
+{
+  if ((*req = _new(SESSION_REQ_RECV, r, NULL)) == NULL) return -1;
+  (*req)->arr = arr;
+  (*req)->countp = count;
+  _queue(*req);
+  _progress(r->s, 0);
+  return 0;
+}
+
+
+inline int ibcast_int_array(const int arr[], size_t count, session *s, request **req)
+{
+  return isend_int_array(arr, count, s->r(s, "_Others"), NULL, req);
+}
+
+
+inline int ibrecv_int_array(int *arr, size_t *count, session *s, request **req)
+{
+  return irecv_int_array(arr, count, s->r(s, "_Others"), req);
+}
+
+
+int send_int_array_init(const int arr[], size_t count, role *r, const char *label, request **req)
+{
+  if ((*req = _new(SESSION_REQ_SEND, r, label)) == NULL) return -1;
+  (*req)->arr = (int *)arr;
+  (*req)->count = count;
+  (*req)->persistent = 1;
+  return 0;
+}
+
+
+int recv_int_array_init(int *arr, size_t *count, role *r, request **req)
+{
+  if ((*req = _new(SESSION_REQ_RECV, r, NULL)) == NULL) return -1;
+  (*req)->arr = arr;
+  (*req)->count = *count; // Capacity, restored at every start.
+  (*req)->countp = count;
+  (*req)->persistent = 1;
+  return 0;
+}
+
+
+int request_start(request *req)
+{
+  if (!req->persistent || req->active) {
+    fprintf(stderr, "%s: Request is not an inactive persistent request\n", __FUNCTION__);
+    return -1;
+  }
+
+  if (req->type == SESSION_REQ_RECV) {
+    *req->countp = req->count;
+  }
+  _queue(req);
+  _progress(req->r->s, 0);
+  return 0;
+}
+
+
+int request_startall(int count, request *reqs[])
+{
+  int rc = 0;
+  int i;
+
+  for (i=0; i<count; ++i) {
+    rc |= request_start(reqs[i]);
+  }
+
+  return rc;
+}
+
+
+void request_free(request **req)
+{
+  if (*req == NULL) return;
+
+  if ((*req)->active) {
+    request_wait(req);
+  }
+  sc_pool_free(*req);
+  *req = NULL;
+}
+
+
+int request_wait(request **req)
+{
+  if (*req == NULL || !(*req)->active) return 0;
+
+  while (!(*req)->complete) {
+    _progress((*req)->r->s, 1);
+  }
+  __sync_synchronize();
+
+  return _retire(req);
+}
+
+
+int request_test(request **req, int *flag)
+{
+  *flag = 0;
+  if (*req == NULL || !(*req)->active) {
+    *flag = 1;
+    return 0;
+  }
+
+  _progress((*req)->r->s, 0);
+  if (!(*req)->complete) return 0;
+  __sync_synchronize();
+
+  *flag = 1;
+  return _retire(req);
+}
+
+
+int request_waitall(int count, request *reqs[])
+{
+  int rc = 0;
+  int i;
+
+  for (i=0; i<count; ++i) {
+    rc |= request_wait(&reqs[i]);
+  }
+
+  return (rc == 0) ? 0 : -1;
+}
+
+
+int request_waitany(int count, request *reqs[], int *index)
+{
+  int i;
+  session *s;
+
+  *index = -1;
+  while (1) {
+    s = NULL;
+    for (i=0; i<count; ++i) {
+      if (reqs[i] == NULL || !reqs[i]->active) continue;
+      if (s == NULL) s = reqs[i]->r->s;
+      _progress(reqs[i]->r->s, 0);
+      if (reqs[i]->complete) {
+        __sync_synchronize();
+        *index = i;
+        return _retire(&reqs[i]);
+      }
+    }
+    if (s == NULL) return 0; // No active requests.
+    _progress(s, 1);
+  }
+}
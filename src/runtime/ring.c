@@ -0,0 +1,592 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * shared memory ring transport module.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include <zmq.h>
+
+#include "sc/pool.h"
+#include "sc/ring.h"
+
+#define RING_SIZE  (1024 * 1024) // Bytes per direction (power of two).
+#define RING_ALIGN 8             // Frames start 8-byte aligned.
+#define RING_SPIN  4096          // Polls before sleeping on the futex.
+#define RING_NAP   50000         // Nanoseconds asleep while other rings have sends queued.
+#define RING_PARTS 16            // Initial send queue length.
+#define RING_RETRY 10000         // Microseconds between attach attempts.
+
+#define RING_CREATED  1 // Segment initialised by the server.
+#define RING_ATTACHED 2 // Client mapped the segment (name removed).
+
+#define RING_WAIT_ROOM  1 // Producer sleeps on tail.
+#define RING_WAIT_INPUT 2 // Producer sleeps on head of its receive ring.
+
+
+/**
+ * A single-producer/single-consumer ring.
+ *
+ * head and tail count bytes written and read (wrapping), each on
+ * its own cache line. A frame is a header followed by the payload,
+ * which may be larger than the ring and is then streamed through.
+ */
+struct ring
+{
+  volatile uint32_t head;
+  char pad0[60];
+  volatile uint32_t tail;
+  char pad1[60];
+  volatile int cons_sleeping; // Consumer waits on head.
+  volatile int prod_sleeping; // Producer waits (RING_WAIT_*).
+  char pad2[56];
+  char data[RING_SIZE];
+};
+
+struct ring_frame
+{
+  uint32_t size;
+  uint32_t more;
+};
+
+/**
+ * A shared memory segment: rings in both directions.
+ *
+ * The server removes a stale segment and creates a new one, the
+ * client attaches to it (while the server lives) and removes the
+ * name, so neither side of a later run can attach to it.
+ */
+struct ring_seg
+{
+  volatile uint32_t state; // RING_CREATED, RING_ATTACHED.
+  volatile int32_t pid;    // Server process.
+  volatile uint32_t closed[2]; // Side closed (server, client).
+  char pad[48];
+  struct ring rings[2];
+};
+
+/**
+ * A connection, frames that do not fit in the ring are queued.
+ */
+struct ring_conn
+{
+  char name[32];
+  session *s;
+  struct ring_seg *seg;
+  struct ring *tx;
+  struct ring *rx;
+  int side; // 0: server, 1: client.
+  int more; // Last received frame is followed by another.
+
+  // Parts queued for sending, the first tx_off bytes of parts[0]
+  // (header and padded payload) are in the ring.
+  zmq_msg_t *parts;
+  struct ring_frame *hdrs;
+  int nparts;
+  int maxparts;
+  size_t tx_off;
+};
+
+
+static inline void _wait(volatile uint32_t *addr, uint32_t val)
+{
+#ifdef SYS_futex
+  syscall(SYS_futex, addr, FUTEX_WAIT, val, NULL, NULL, 0);
+#else
+  sched_yield();
+#endif
+}
+
+
+static inline void _nap(volatile uint32_t *addr, uint32_t val)
+{
+#ifdef SYS_futex
+  struct timespec timeout = { 0, RING_NAP };
+  syscall(SYS_futex, addr, FUTEX_WAIT, val, &timeout, NULL, 0);
+#else
+  sched_yield();
+#endif
+}
+
+
+static inline void _wake(volatile uint32_t *addr)
+{
+#ifdef SYS_futex
+  syscall(SYS_futex, addr, FUTEX_WAKE, 1, NULL, NULL, 0);
+#endif
+}
+
+
+/**
+ * \brief Helper function to wait until the ring holds at least n bytes.
+ *
+ * \returns Number of bytes in the ring.
+ */
+static uint32_t _wait_data(struct ring *r, uint32_t n)
+{
+  uint32_t head;
+  int spin;
+
+  for (spin=0; spin<RING_SPIN; ++spin) {
+    if ((head = r->head) - r->tail >= n) return head - r->tail;
+  }
+
+  for (;;) {
+    r->cons_sleeping = 1;
+    __sync_synchronize();
+    if ((head = r->head) - r->tail >= n) break;
+    _wait(&r->head, head);
+  }
+  r->cons_sleeping = 0;
+
+  return head - r->tail;
+}
+
+
+/**
+ * \brief Helper function to publish n bytes written to the ring.
+ *
+ */
+static inline void _produce(struct ring *r, uint32_t n)
+{
+  __sync_synchronize();
+  r->head += n;
+  __sync_synchronize();
+  if (r->cons_sleeping) _wake(&r->head);
+}
+
+
+/**
+ * \brief Helper function to release n bytes read from a connection.
+ *
+ * The producer may wait for input on the ring it sends to us.
+ */
+static inline void _consume(struct ring_conn *conn, uint32_t n)
+{
+  struct ring *r = conn->rx;
+
+  __sync_synchronize();
+  r->tail += n;
+  __sync_synchronize();
+  if (r->prod_sleeping == RING_WAIT_ROOM) _wake(&r->tail);
+  else if (r->prod_sleeping == RING_WAIT_INPUT) _wake(&conn->tx->head);
+}
+
+
+/**
+ * \brief Helper function to copy to the ring at pos (wrapping).
+ *
+ */
+static void _copy_in(struct ring *r, uint32_t pos, const char *src, size_t n)
+{
+  size_t off = pos & (RING_SIZE - 1);
+  size_t first = (n < RING_SIZE - off) ? n : RING_SIZE - off;
+
+  memcpy(r->data + off, src, first);
+  memcpy(r->data, src + first, n - first);
+}
+
+
+/**
+ * \brief Helper function to copy from the ring at pos (wrapping).
+ *
+ */
+static void _copy_out(struct ring *r, uint32_t pos, char *dst, size_t n)
+{
+  size_t off = pos & (RING_SIZE - 1);
+  size_t first = (n < RING_SIZE - off) ? n : RING_SIZE - off;
+
+  memcpy(dst, r->data + off, first);
+  memcpy(dst + first, r->data, n - first);
+}
+
+
+/**
+ * \brief Helper function to queue a message part for sending.
+ *
+ */
+static void _enqueue(struct ring_conn *conn, zmq_msg_t *msg, int flags)
+{
+  int part_idx;
+
+  if (conn->nparts == conn->maxparts) {
+    conn->maxparts = (conn->maxparts == 0) ? RING_PARTS : conn->maxparts * 2;
+    conn->parts = (zmq_msg_t *)realloc(conn->parts, sizeof(zmq_msg_t) * conn->maxparts);
+    conn->hdrs = (struct ring_frame *)realloc(conn->hdrs, sizeof(struct ring_frame) * conn->maxparts);
+  }
+
+  // Sent like zmq_send: ownership moves to the transport, msg is left empty.
+  part_idx = conn->nparts++;
+  zmq_msg_init(&conn->parts[part_idx]);
+  zmq_msg_move(&conn->parts[part_idx], msg);
+  conn->hdrs[part_idx].size = zmq_msg_size(&conn->parts[part_idx]);
+  conn->hdrs[part_idx].more = (flags & ZMQ_SNDMORE) != 0;
+}
+
+
+/**
+ * \brief Helper function to copy queued parts into the ring, without waiting.
+ *
+ * Frames larger than the ring pass through in pieces.
+ */
+static void _drain(struct ring_conn *conn)
+{
+  struct ring *r = conn->tx;
+  struct ring_frame *frame;
+  const char *data;
+  size_t padded, done;
+  uint32_t room;
+
+  while (conn->nparts > 0) {
+    frame = &conn->hdrs[0];
+    room = (RING_SIZE - (r->head - r->tail)) & ~(uint32_t)(RING_ALIGN - 1);
+
+    if (conn->tx_off == 0) {
+      if (room < sizeof(struct ring_frame)) return;
+      _copy_in(r, r->head, (const char *)frame, sizeof(struct ring_frame));
+      _produce(r, sizeof(struct ring_frame));
+      conn->tx_off = sizeof(struct ring_frame);
+      room -= sizeof(struct ring_frame);
+    }
+
+    data = (const char *)zmq_msg_data(&conn->parts[0]);
+    padded = (frame->size + RING_ALIGN - 1) & ~(size_t)(RING_ALIGN - 1);
+    done = conn->tx_off - sizeof(struct ring_frame);
+    if (room > padded - done) room = padded - done;
+    if (room > 0) {
+      if (done < frame->size) {
+        _copy_in(r, r->head, data + done, (done + room <= frame->size) ? room : frame->size - done);
+      }
+      _produce(r, room);
+      done += room;
+      conn->tx_off += room;
+    }
+    if (done < padded) return; // Ring is full.
+
+    // zmq_msg_t is moved by copying (as zmq_msg_move does).
+    zmq_msg_close(&conn->parts[0]);
+    conn->nparts--;
+    memmove(conn->parts, conn->parts + 1, sizeof(zmq_msg_t) * conn->nparts);
+    memmove(conn->hdrs, conn->hdrs + 1, sizeof(struct ring_frame) * conn->nparts);
+    conn->tx_off = 0;
+  }
+}
+
+
+/**
+ * \brief Helper function to copy the parts queued on all rings of a session.
+ *
+ * \returns 1 if parts remain queued on rings other than conn's.
+ */
+static int _drain_all(struct ring_conn *conn)
+{
+  struct role_endpoint *ep;
+  struct ring_conn *other;
+  unsigned role_idx;
+  int queued = 0;
+
+  _drain(conn);
+  if (conn->s == NULL) return 0;
+  for (role_idx=0; role_idx<conn->s->nrole; ++role_idx) {
+    if (conn->s->roles[role_idx]->type != SESSION_ROLE_P2P) continue;
+    ep = conn->s->roles[role_idx]->p2p;
+    if (ep->tp != &transport_shm || (other = (struct ring_conn *)ep->ptr) == NULL || other == conn) continue;
+    if (other->nparts > 0) _drain(other);
+    queued |= (other->nparts > 0);
+  }
+
+  return queued;
+}
+
+
+/**
+ * \brief Helper function to wait until n bytes can be received.
+ *
+ * Queued parts are copied into the rings meanwhile, the peers
+ * may have to receive them before they send.
+ *
+ * \returns Number of bytes in the receive ring.
+ */
+static uint32_t _wait_input(struct ring_conn *conn, uint32_t n)
+{
+  struct ring *r = conn->rx;
+  uint32_t head;
+  int others, spin;
+
+  for (spin=0; ; ++spin) {
+    others = _drain_all(conn);
+    if ((head = r->head) - r->tail >= n) return head - r->tail;
+    if (conn->nparts == 0 && !others) return _wait_data(r, n);
+    if (spin < RING_SPIN) continue;
+
+    // Woken by the peer's send, or by it making room (see _consume()).
+    r->cons_sleeping = 1;
+    if (conn->nparts > 0) conn->tx->prod_sleeping = RING_WAIT_INPUT;
+    __sync_synchronize();
+    if ((head = r->head) - r->tail < n
+        && (conn->nparts == 0 || RING_SIZE - (conn->tx->head - conn->tx->tail) < RING_ALIGN)) {
+      // Timed while parts are queued: a wake from _consume() racing this check is lost.
+      if (others || conn->nparts > 0) _nap(&r->head, head); else _wait(&r->head, head);
+    }
+    conn->tx->prod_sleeping = 0;
+    r->cons_sleeping = 0;
+  }
+}
+
+
+/**
+ * \brief Helper function to check if a server process is still running.
+ *
+ */
+static int _alive(pid_t pid)
+{
+  return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+
+/**
+ * \brief Helper function to create the segment of a server.
+ *
+ * A segment left by an earlier run is removed, the new one is
+ * zero-filled (empty rings).
+ */
+static struct ring_seg *_seg_create(const char *name)
+{
+  struct ring_seg *seg;
+  int fd;
+
+  shm_unlink(name);
+  if ((fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600)) < 0) return NULL;
+  if (ftruncate(fd, sizeof(struct ring_seg)) != 0) {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  seg = (struct ring_seg *)mmap(NULL, sizeof(struct ring_seg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (seg == MAP_FAILED) {
+    shm_unlink(name);
+    return NULL;
+  }
+
+  seg->pid = getpid();
+  __sync_synchronize();
+  seg->state = RING_CREATED;
+
+  return seg;
+}
+
+
+/**
+ * \brief Helper function to attach a client to the segment of its server.
+ *
+ * Retries until the server has created the segment, a segment
+ * of a server that is gone (or already attached) is stale.
+ */
+static struct ring_seg *_seg_attach(const char *name)
+{
+  struct ring_seg *seg;
+  struct stat st;
+  int fd;
+
+  for (;;) {
+    if ((fd = shm_open(name, O_RDWR, 0600)) < 0) {
+      if (errno != ENOENT) return NULL;
+      usleep(RING_RETRY);
+      continue;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct ring_seg)) { // Being created.
+      close(fd);
+      usleep(RING_RETRY);
+      continue;
+    }
+    seg = (struct ring_seg *)mmap(NULL, sizeof(struct ring_seg), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED) return NULL;
+
+    if (seg->state == RING_CREATED && _alive(seg->pid)
+        && __sync_bool_compare_and_swap(&seg->state, RING_CREATED, RING_ATTACHED)) {
+      shm_unlink(name); // Both sides mapped, the segment lives until both unmap.
+      return seg;
+    }
+    munmap(seg, sizeof(struct ring_seg));
+    usleep(RING_RETRY); // Not initialised yet, or stale (replaced by the server).
+  }
+}
+
+
+static int _ring_connect(struct role_endpoint *ep, session *s, const char *host, unsigned port, int server)
+{
+  struct ring_conn *conn = (struct ring_conn *)calloc(1, sizeof(struct ring_conn));
+
+  snprintf(conn->name, sizeof(conn->name), "/sessionc-ring-%u", port);
+  sprintf(ep->uri, "shm://%s", conn->name);
+
+  conn->seg = server ? _seg_create(conn->name) : _seg_attach(conn->name);
+  if (conn->seg == NULL) {
+    perror(__FUNCTION__);
+    free(conn);
+    return -1;
+  }
+
+  conn->s = s;
+  conn->side = server ? 0 : 1;
+  conn->tx = &conn->seg->rings[server ? 0 : 1];
+  conn->rx = &conn->seg->rings[server ? 1 : 0];
+  conn->more = 0;
+  ep->ptr = conn;
+
+  return 0;
+}
+
+
+static int _ring_send(struct role_endpoint *ep, void *msg, int flags)
+{
+  struct ring_conn *conn = (struct ring_conn *)ep->ptr;
+
+  // What does not fit stays queued, copied in while the role waits
+  // (recv, poll, send_flush) or closes; a send never waits for the peer.
+  _enqueue(conn, (zmq_msg_t *)msg, flags);
+  _drain(conn);
+
+  return 0;
+}
+
+
+static int _ring_recv(struct role_endpoint *ep, void *msg, int flags)
+{
+  struct ring_conn *conn = (struct ring_conn *)ep->ptr;
+  struct ring *r = conn->rx;
+  struct ring_frame frame;
+  size_t padded, done = 0;
+  uint32_t avail;
+  char *data;
+
+  if (flags & ZMQ_NOBLOCK) {
+    _drain(conn);
+    if (r->head == r->tail) {
+      errno = EAGAIN;
+      return -1;
+    }
+  }
+
+  _wait_input(conn, sizeof(frame));
+  _copy_out(r, r->tail, (char *)&frame, sizeof(frame));
+  _consume(conn, sizeof(frame));
+  conn->more = frame.more;
+  padded = (frame.size + RING_ALIGN - 1) & ~(size_t)(RING_ALIGN - 1);
+
+  zmq_msg_close((zmq_msg_t *)msg);
+  if (frame.size == 0) {
+    zmq_msg_init_size((zmq_msg_t *)msg, 0);
+    return 0;
+  }
+  data = (char *)sc_pool_alloc(frame.size);
+  zmq_msg_init_data((zmq_msg_t *)msg, data, frame.size, sc_pool_free_fn, NULL);
+
+  while (done < padded) {
+    avail = _wait_input(conn, RING_ALIGN);
+    avail &= ~(uint32_t)(RING_ALIGN - 1);
+    if (avail > padded - done) avail = padded - done;
+    if (done < frame.size) {
+      _copy_out(r, r->tail, data + done, (done + avail <= frame.size) ? avail : frame.size - done);
+    }
+    _consume(conn, avail);
+    done += avail;
+  }
+
+  return 0;
+}
+
+
+static int _ring_more(struct role_endpoint *ep)
+{
+  return ((struct ring_conn *)ep->ptr)->more;
+}
+
+
+static int _ring_poll(struct role_endpoint *ep, void *item, short events)
+{
+  struct ring_conn *conn = (struct ring_conn *)ep->ptr;
+
+  _drain(conn);
+  if (events & ZMQ_POLLOUT) return (conn->nparts == 0) ? 1 : -1;
+  if (conn->rx->head != conn->rx->tail) return 1;
+  return -1; // Nothing to hand to zmq_poll, check again.
+}
+
+
+static int _ring_flush(struct role_endpoint *ep)
+{
+  _drain((struct ring_conn *)ep->ptr);
+  return 0;
+}
+
+
+static int _ring_close(struct role_endpoint *ep)
+{
+  struct ring_conn *conn = (struct ring_conn *)ep->ptr;
+  struct ring_seg *seg = conn->seg;
+  struct ring *r = conn->tx;
+  uint32_t tail;
+  int part_idx;
+
+  // Linger until the queued parts are in the ring (as ZeroMQ does),
+  // unless the peer has closed, and the client has the segment.
+  for (_drain(conn); conn->nparts > 0 && !seg->closed[1 - conn->side]; _drain(conn)) {
+    r->prod_sleeping = RING_WAIT_ROOM;
+    __sync_synchronize();
+    tail = r->tail;
+    if (RING_SIZE - (r->head - tail) < RING_ALIGN && !seg->closed[1 - conn->side]) {
+      _wait(&r->tail, tail);
+    }
+    r->prod_sleeping = 0;
+  }
+  while (conn->side == 0 && seg->state != RING_ATTACHED) {
+    usleep(RING_RETRY);
+  }
+
+  seg->closed[conn->side] = 1;
+  __sync_synchronize();
+  _wake(&conn->rx->tail); // The peer may linger for room.
+
+  for (part_idx=0; part_idx<conn->nparts; ++part_idx) {
+    zmq_msg_close(&conn->parts[part_idx]);
+  }
+  free(conn->parts);
+  free(conn->hdrs);
+  munmap(seg, sizeof(struct ring_seg));
+  free(conn);
+  ep->ptr = NULL;
+
+  return 0;
+}
+
+
+const transport transport_shm = {
+  "shm",
+  _ring_connect,
+  _ring_send,
+  _ring_recv,
+  _ring_more,
+  _ring_poll,
+  _ring_close,
+  _ring_flush
+};
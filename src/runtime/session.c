@@ -6,6 +6,8 @@
 
 #include <assert.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,18 +18,25 @@
 #include "connmgr.h"
 #include "st_node.h"
 
+#include "sc/pool.h"
+#include "sc/primitives.h"
 #include "sc/session.h"
+#include "sc/shm.h"
+#include "sc/transport.h"
 #include "sc/types.h"
 #include "sc/utils.h"
 
 
 extern FILE *yyin;
 extern int yyparse(st_tree *tree);
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
 #ifdef __DEBUG__
 long long DEBUG_prog_start_time;
 long long DEBUG_sess_start_time;
 long long DEBUG_sess_end_time;
 long long DEBUG_prog_end_time;
+int DEBUG_alltoall_count = 0;
+long long DEBUG_alltoall_time = 0;
 #endif
 
 
@@ -71,9 +80,205 @@ static role *find_role_in_session(session *s, char *role_name)
 }
 
 
-void session_init(int *argc, char ***argv, session **s, const char *scribble)
+/**
+ * Helper function to intern message labels of a local protocol.
+ *
+ * Returns -1 if two labels have the same key (they
+ * could not be told apart on the wire), 0 otherwise.
+ */
+static int add_labels(session *s, const st_node *node)
+{
+  int child_idx;
+  unsigned int label_idx;
+  unsigned int key;
+  const char *label;
+
+  if (node == NULL) return 0;
+
+  if ((node->type == ST_NODE_SEND || node->type == ST_NODE_RECV)
+      && node->interaction->msgsig.op != NULL
+      && session_label_id(s, node->interaction->msgsig.op) == -1) {
+    label = node->interaction->msgsig.op;
+    key = sc_label_hash(label);
+    for (label_idx=0; label_idx<s->nlabel; ++label_idx) {
+      if (s->label_keys[label_idx] == key) {
+        fprintf(stderr, "Error: labels %s and %s have the same key %u\n",
+            s->labels[label_idx], label, key);
+        return -1;
+      }
+    }
+
+    s->labels = (char **)realloc(s->labels, sizeof(char *) * (s->nlabel+1));
+    s->label_keys = (unsigned int *)realloc(s->label_keys, sizeof(unsigned int) * (s->nlabel+1));
+    s->labels[s->nlabel] = (char *)calloc(sizeof(char), strlen(label)+1);
+    strcpy(s->labels[s->nlabel], label);
+    s->label_keys[s->nlabel] = key;
+    s->nlabel++;
+  }
+
+  for (child_idx=0; child_idx<node->nchild; ++child_idx) {
+    if (add_labels(s, node->children[child_idx]) != 0) return -1;
+  }
+
+  return 0;
+}
+
+
+/**
+ * Helper function to reset the message buffers of an endpoint.
+ *
+ */
+static void init_endpoint(struct role_endpoint *ep)
+{
+  ep->host = NULL;
+  ep->tp = &transport_zmq;
+  ep->ptr = NULL;
+  ep->rx = NULL;
+  ep->rx_offset = 0;
+  ep->rx_size = 0;
+  ep->rx_parts = 0;
+  ep->rx_pending = 0;
+  ep->rx_tokens = 0;
+  ep->rx_held = NULL;
+  ep->rx_held_more = NULL;
+  ep->rx_nheld = 0;
+  ep->rx_maxheld = 0;
+  ep->rx_taken = 0;
+  ep->rx_more = 0;
+  ep->tx = NULL;
+  ep->tx_size = 0;
+  ep->tx_cap = 0;
+  ep->tx_parts = 0;
+  ep->tx_hold = 0;
+}
+
+
+/**
+ * Helper function to look up the host of a role in the connmgr role-to-host map.
+ *
+ */
+static char *role_host(const host_map hosts_roles[], int nroles, const char *name)
+{
+  int map_idx;
+  char *host;
+
+  for (map_idx=0; map_idx<nroles; map_idx++) {
+    if (strcmp(hosts_roles[map_idx].role, name) == 0) {
+      host = (char *)calloc(sizeof(char), strlen(hosts_roles[map_idx].host)+1);
+      strcpy(host, hosts_roles[map_idx].host);
+      return host;
+    }
+  }
+
+  return NULL;
+}
+
+
+/**
+ * Helper function to get the single P2P recipient of a send node.
+ *
+ */
+static role *send_target(session *s, const st_node *node)
+{
+  unsigned int role_idx;
+
+  if (node == NULL || node->type != ST_NODE_SEND) return NULL;
+  if (node->interaction->nto != 1 || node->interaction->to_type != ST_ROLE_NORMAL) return NULL;
+
+  for (role_idx=0; role_idx<s->nrole; ++role_idx) {
+    if (s->roles[role_idx]->type == SESSION_ROLE_P2P
+        && strcmp(s->roles[role_idx]->p2p->name, node->interaction->to[0]) == 0) {
+      return s->roles[role_idx];
+    }
+  }
+  return NULL;
+}
+
+
+/**
+ * Helper function to mark roles the local protocol sends
+ * runs of messages to, whose sends are coalesced (or corked).
+ *
+ * A run is two consecutive sends to the same role in a block, or
+ * a recursion that both starts and ends with a send to the role.
+ */
+static void mark_send_runs(session *s, const st_node *node)
+{
+  int child_idx;
+  int last;
+  role *r;
+
+  if (node == NULL) return;
+
+  for (child_idx=0; child_idx+1<node->nchild; ++child_idx) {
+    r = send_target(s, node->children[child_idx]);
+    if (r != NULL && r == send_target(s, node->children[child_idx+1])) {
+      r->p2p->tx_hold = 1;
+    }
+  }
+
+  if (node->type == ST_NODE_RECUR && node->nchild > 0) {
+    last = node->nchild - 1;
+    if (last > 0 && node->children[last]->type == ST_NODE_CONTINUE) last--;
+    r = send_target(s, node->children[0]);
+    if (r != NULL && r == send_target(s, node->children[last])) {
+      r->p2p->tx_hold = 1;
+    }
+  }
+
+  for (child_idx=0; child_idx<node->nchild; ++child_idx) {
+    mark_send_runs(s, node->children[child_idx]);
+  }
+}
+
+
+/**
+ * Helper function to mark the roles a local protocol interacts with.
+ *
+ */
+static void mark_neighbours(session *s, const st_node *node, int marked[])
+{
+  int child_idx;
+  int to_idx;
+  unsigned int role_idx;
+
+  if (node == NULL) return;
+
+  for (role_idx=0; role_idx<s->nrole; ++role_idx) {
+    if (s->roles[role_idx]->type != SESSION_ROLE_P2P) continue;
+    if (node->type == ST_NODE_SEND && node->interaction->to_type == ST_ROLE_NORMAL) {
+      for (to_idx=0; to_idx<node->interaction->nto; ++to_idx) {
+        if (strcmp(node->interaction->to[to_idx], s->roles[role_idx]->p2p->name) == 0) {
+          marked[role_idx] = 1;
+        }
+      }
+    }
+    if (node->type == ST_NODE_RECV && node->interaction->from_type == ST_ROLE_NORMAL
+        && strcmp(node->interaction->from, s->roles[role_idx]->p2p->name) == 0) {
+      marked[role_idx] = 1;
+    }
+  }
+
+  for (child_idx=0; child_idx<node->nchild; ++child_idx) {
+    mark_neighbours(s, node->children[child_idx], marked);
+  }
+}
+
+
+static int neighbour_cmp(const void *a, const void *b)
+{
+  return strcmp((*(role * const *)a)->p2p->name, (*(role * const *)b)->p2p->name);
+}
+
+
+/**
+ * Helper function to initialise a session (see session_init).
+ *
+ */
+static void init_session(int *argc, char ***argv, session **s, const char *scribble)
 {
   unsigned int role_idx;
+  unsigned int label_idx;
 #ifdef __DEBUG__
   sc_print_version();
   DEBUG_prog_start_time = sc_time();
@@ -96,6 +301,7 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
   // Sanity check.
   if (tree->info->global) {
     fprintf(stderr, "Error: %s is a Global protocol\n", scribble);
+    *s = NULL;
     return;
   }
 
@@ -104,18 +310,23 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
   char *config_file = NULL;
   char *hosts_file = NULL;
   char *protocol_file = NULL;
+  int coalesce = 0;
+  int barrier_alg = SESSION_BARRIER_CENTRAL;
 
   // Invoke getopt to extract arguments we need
+  optind = 0; // Rescan from the start, session_init may run once per thread.
   while (1) {
     static struct option long_options[] = {
       {"conf",     required_argument, 0, 'c'},
       {"hosts",    required_argument, 0, 's'},
       {"protocol", required_argument, 0, 'p'},
+      {"coalesce", no_argument,       0, 'C'},
+      {"barrier",  required_argument, 0, 'b'},
       {0, 0, 0, 0}
     };
 
     int option_idx = 0;
-    option = getopt_long(*argc, *argv, "c:s:p:", long_options, &option_idx);
+    option = getopt_long(*argc, *argv, "c:s:p:Cb:", long_options, &option_idx);
 
     if (option == -1) break;
 
@@ -135,6 +346,20 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
         strcpy(protocol_file, optarg);
         fprintf(stderr, "Using protocol file %s\n", protocol_file);
         break;
+      case 'C':
+        coalesce = 1;
+        fprintf(stderr, "Coalescing sends\n");
+        break;
+      case 'b':
+        if (strcmp(optarg, "dissemination") == 0) {
+          barrier_alg = SESSION_BARRIER_DISSEMINATION;
+        } else if (strcmp(optarg, "tournament") == 0) {
+          barrier_alg = SESSION_BARRIER_TOURNAMENT;
+        } else if (strcmp(optarg, "central") != 0) {
+          fprintf(stderr, "Warning: unknown barrier `%s', using central\n", optarg);
+        }
+        fprintf(stderr, "Using %s barrier\n", optarg);
+        break;
     }
   }
 
@@ -150,6 +375,9 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
   int nroles;
   host_map *hosts_roles;
   int conn_idx;
+  int server;
+  int pass;
+  const char *addr;
 
   if (config_file == NULL) { // Generate dynamic connection parameters (config file absent).
 
@@ -183,6 +411,30 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
 
   sess->name = (char *)calloc(sizeof(char), strlen(tree->info->myrole)+1);
   strcpy(sess->name, tree->info->myrole);
+  sess->host = role_host(hosts_roles, nroles, sess->name);
+
+  // Intern message labels (label ID is the index in sess->labels).
+  sess->nlabel = 0;
+  sess->labels = NULL;
+  sess->label_keys = NULL;
+  if (add_labels(sess, tree->root) != 0) {
+    for (label_idx=0; label_idx<sess->nlabel; ++label_idx) {
+      free(sess->labels[label_idx]);
+    }
+    free(sess->labels);
+    free(sess->label_keys);
+    free(sess->name);
+    free(sess);
+    *s = NULL;
+    return;
+  }
+
+  sess->reqs = NULL;
+  sess->issuing = NULL;
+  sess->shm = NULL;
+  sess->uring = NULL;
+  sess->coalesce = coalesce;
+  sess->barrier = barrier_alg;
 
   // Direct connections (p2p).
   sess->nrole = tree->info->nrole;
@@ -194,53 +446,65 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
     sess->roles[role_idx]->type = SESSION_ROLE_P2P;
     sess->roles[role_idx]->s = sess;
     sess->roles[role_idx]->p2p = (struct role_endpoint *)malloc(sizeof(struct role_endpoint));
+    init_endpoint(sess->roles[role_idx]->p2p);
 
     sess->roles[role_idx]->p2p->name = (char *)calloc(sizeof(char), strlen(tree->info->roles[role_idx])+1);
     strcpy(sess->roles[role_idx]->p2p->name, tree->info->roles[role_idx]);
+    sess->roles[role_idx]->p2p->host = role_host(hosts_roles, nroles, sess->roles[role_idx]->p2p->name);
+  }
 
-    for (conn_idx=0; conn_idx<nconns; conn_idx++) { // Look for matching connection parameter
+  // Server endpoints first: a client waiting for its server to listen
+  // (see sc/tcp.h) never waits on a role that is itself connecting.
+  for (pass=1; pass>=0; pass--) {
+    for (role_idx=0; role_idx<sess->nrole; role_idx++) {
 
-      if ((CONNMGR_TYPE_P2P == conns[conn_idx].type) && strcmp(conns[conn_idx].to, sess->roles[role_idx]->p2p->name) == 0 && strcmp(conns[conn_idx].from, sess->name) == 0) { // As a client.
-        assert(strlen(conns[conn_idx].host) < 255 && conns[conn_idx].port < 65536);
-        if (strstr(conns[conn_idx].host, "ipc:") != NULL) {
-          sprintf(sess->roles[role_idx]->p2p->uri, "ipc:///tmp/sessionc-%u", conns[conn_idx].port);
+      for (conn_idx=0; conn_idx<nconns; conn_idx++) { // Look for matching connection parameter
+
+        if (CONNMGR_TYPE_P2P != conns[conn_idx].type) continue;
+        if (strcmp(conns[conn_idx].to, sess->roles[role_idx]->p2p->name) == 0 && strcmp(conns[conn_idx].from, sess->name) == 0) { // As a client.
+          server = 0;
+        } else if (strcmp(conns[conn_idx].from, sess->roles[role_idx]->p2p->name) == 0 && strcmp(conns[conn_idx].to, sess->name) == 0) { // As a server.
+          server = 1;
         } else {
-          sprintf(sess->roles[role_idx]->p2p->uri, "tcp://%s:%u", conns[conn_idx].host, conns[conn_idx].port);
+          continue;
+        }
+        if (server != pass) break;
+        assert(strlen(conns[conn_idx].host) < 255 && conns[conn_idx].port < 65536);
+
+        // Transport selected by the host field (name:host), ZeroMQ by default.
+        sess->roles[role_idx]->p2p->tp = transport_select(conns[conn_idx].host, &addr);
+        if (sess->roles[role_idx]->p2p->tp->connect(sess->roles[role_idx]->p2p, sess, addr, conns[conn_idx].port, server) != 0) {
+          fprintf(stderr, "Unable to connect %s -> %s (%s)\n",
+              conns[conn_idx].from, conns[conn_idx].to, sess->roles[role_idx]->p2p->tp->name);
         }
 #ifdef __DEBUG__
-        fprintf(stderr, "Connection (as client) %s -> %s is %s\n",
+        fprintf(stderr, "Connection (as %s) %s -> %s is %s:%s\n",
+            server ? "server" : "client",
             conns[conn_idx].from,
             conns[conn_idx].to,
+            sess->roles[role_idx]->p2p->tp->name,
             sess->roles[role_idx]->p2p->uri);
 #endif
-        if ((sess->roles[role_idx]->p2p->ptr = zmq_socket(sess->ctx, ZMQ_PAIR)) == NULL) perror("zmq_socket");
-        if (zmq_connect(sess->roles[role_idx]->p2p->ptr, sess->roles[role_idx]->p2p->uri) != 0) perror("zmq_connect");
-
         break;
-      }
 
-      if ((CONNMGR_TYPE_P2P == conns[conn_idx].type) && strcmp(conns[conn_idx].from, sess->roles[role_idx]->p2p->name) == 0 && strcmp(conns[conn_idx].to, sess->name) == 0) { // As a server.
-        assert(conns[conn_idx].port < 65536);
-        if (strstr(conns[conn_idx].host, "ipc:") != NULL) {
-          sprintf(sess->roles[role_idx]->p2p->uri, "ipc:///tmp/sessionc-%u", conns[conn_idx].port);
-        } else {
-          sprintf(sess->roles[role_idx]->p2p->uri, "tcp://*:%u",conns[conn_idx].port);
-        }
-  #ifdef __DEBUG__
-        fprintf(stderr, "Connection (as server) %s -> %s is %s\n",
-            conns[conn_idx].from,
-            conns[conn_idx].to,
-            sess->roles[role_idx]->p2p->uri);
-  #endif
-        if ((sess->roles[role_idx]->p2p->ptr = zmq_socket(sess->ctx, ZMQ_PAIR)) == NULL) perror("zmq_socket");
-        if (zmq_bind(sess->roles[role_idx]->p2p->ptr, sess->roles[role_idx]->p2p->uri) != 0) perror("zmq_bind");
-
-        break;
       }
 
     }
+  }
+
+  // Runs of sends are coalesced (--coalesce) or corked by the transport.
+  mark_send_runs(sess, tree->root);
 
+  // Neighbours (roles in the local protocol).
+  int *marked = (int *)calloc(sess->nrole, sizeof(int));
+  if (sess->nrole > 0) mark_neighbours(sess, tree->root, marked);
+  sess->nneighbour = 0;
+  sess->neighbours = (role **)malloc(sizeof(role *) * sess->nrole);
+  for (role_idx=0; role_idx<sess->nrole; role_idx++) {
+    if (marked[role_idx]) sess->neighbours[sess->nneighbour++] = sess->roles[role_idx];
   }
+  free(marked);
+  qsort(sess->neighbours, sess->nneighbour, sizeof(role *), neighbour_cmp);
 
   // Add a _Others group role.
   sess->nrole++;
@@ -264,6 +528,8 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
 
   sess->roles[sess->nrole-1]->grp->in  = (struct role_endpoint *)malloc(sizeof(struct role_endpoint));
   sess->roles[sess->nrole-1]->grp->out = (struct role_endpoint *)malloc(sizeof(struct role_endpoint));
+  init_endpoint(sess->roles[sess->nrole-1]->grp->in);
+  init_endpoint(sess->roles[sess->nrole-1]->grp->out);
 
   // Setup a SUB (broadcast-in) socket
   if ((sess->roles[sess->nrole-1]->grp->in->ptr = zmq_socket(sess->ctx, ZMQ_SUB)) == NULL) perror("zmq_socket");
@@ -272,7 +538,11 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
 
   for (conn_idx=0; conn_idx<nconns; conn_idx++) { // Look for the broadcast socket
     if ((CONNMGR_TYPE_GRP == conns[conn_idx].type) && (strcmp(conns[conn_idx].to, sess->name) == 0)) {
-      sprintf(sess->roles[sess->nrole-1]->grp->in->uri, "tcp://*:%u", conns[conn_idx].port);
+      if (strncmp(conns[conn_idx].host, "inproc:", 7) == 0) { // Roles of one process.
+        sprintf(sess->roles[sess->nrole-1]->grp->in->uri, "ipc:///tmp/sessionc-grp-%u", conns[conn_idx].port);
+      } else {
+        sprintf(sess->roles[sess->nrole-1]->grp->in->uri, "tcp://*:%u", conns[conn_idx].port);
+      }
 #ifdef __DEBUG__
       fprintf(stderr, "Broadcast in-socket: %s\n",
         sess->roles[sess->nrole-1]->grp->in->uri);
@@ -284,7 +554,12 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
 
   for (conn_idx=0; conn_idx<nconns; conn_idx++) { // Look for the broadcast socket
     if ((CONNMGR_TYPE_GRP == conns[conn_idx].type) && (strcmp(conns[conn_idx].to, sess->name) != 0)) {
-      sprintf(sess->roles[sess->nrole-1]->grp->out->uri, "tcp://%s:%u", conns[conn_idx].host, conns[conn_idx].port);
+      if (strncmp(conns[conn_idx].host, "inproc:", 7) == 0) {
+        sprintf(sess->roles[sess->nrole-1]->grp->out->uri, "ipc:///tmp/sessionc-grp-%u", conns[conn_idx].port);
+      } else { // Broadcasts go over ZeroMQ, whatever the transport prefix.
+        transport_select(conns[conn_idx].host, &addr);
+        sprintf(sess->roles[sess->nrole-1]->grp->out->uri, "tcp://%s:%u", addr, conns[conn_idx].port);
+      }
 #ifdef __DEBUG__
       fprintf(stderr, "Broadcast out-socket: %s\n",
         sess->roles[sess->nrole-1]->grp->out->uri);
@@ -306,39 +581,137 @@ void session_init(int *argc, char ***argv, session **s, const char *scribble)
 }
 
 
+void session_init(int *argc, char ***argv, session **s, const char *scribble)
+{
+  // The parser and getopt are not reentrant, roles running as
+  // threads of one process initialise their sessions in turn.
+  pthread_mutex_lock(&init_lock);
+  init_session(argc, argv, s, scribble);
+  pthread_mutex_unlock(&init_lock);
+}
+
+
+int session_neighbours(const session *s, role ***neighbours)
+{
+  *neighbours = s->neighbours;
+  return s->nneighbour;
+}
+
+
+int session_label_id(const session *s, const char *label)
+{
+  unsigned int label_idx;
+  for (label_idx=0; label_idx<s->nlabel; ++label_idx) {
+    if (strcmp(s->labels[label_idx], label) == 0) {
+      return label_idx;
+    }
+  }
+  return -1;
+}
+
+
 role *session_group(session *s, const char *name, int nrole, ...)
 {
-  assert(0);
-  return NULL;
+  int role_idx;
+  role *r;
+  role *grp;
+  va_list roles;
+
+  grp = (role *)malloc(sizeof(role));
+  grp->type = SESSION_ROLE_GRP;
+  grp->s = s;
+  grp->grp = (struct role_group *)malloc(sizeof(struct role_group));
+  grp->grp->name = (char *)calloc(sizeof(char), strlen(name)+1);
+  strcpy(grp->grp->name, name);
+  grp->grp->nendpoint = 0;
+  grp->grp->endpoints = (struct role_endpoint **)malloc(sizeof(struct role_endpoint *) * (nrole > 0 ? nrole : 1));
+
+  // Sub-groups have no PUB/SUB sockets, members are reached directly.
+  grp->grp->in = NULL;
+  grp->grp->out = NULL;
+
+  va_start(roles, nrole);
+  for (role_idx=0; role_idx<nrole; role_idx++) {
+    r = va_arg(roles, role *);
+    if (r == NULL || r->type != SESSION_ROLE_P2P) {
+      // Members would rank groups of different sizes.
+      fprintf(stderr, "%s: Member #%d of group %s is not a point-to-point role\n", __FUNCTION__, role_idx, name);
+      va_end(roles);
+      free(grp->grp->endpoints);
+      free(grp->grp->name);
+      free(grp->grp);
+      free(grp);
+      return NULL;
+    }
+    grp->grp->endpoints[grp->grp->nendpoint++] = r->p2p;
+  }
+  va_end(roles);
+
+#ifdef __DEBUG__
+  fprintf(stderr, "%s: { group: %s, %u members }\n", __FUNCTION__, name, grp->grp->nendpoint);
+#endif
+
+  s->nrole++;
+  s->roles = (role **)realloc(s->roles, sizeof(role *) * s->nrole);
+  s->roles[s->nrole-1] = grp;
+
+  return grp;
 }
 
 
 void session_end(session *s)
 {
-  unsigned int role_idx;
+  unsigned int role_idx, held_idx;
   unsigned int role_count = s->nrole;
 
 #ifdef __DEBUG__
   DEBUG_sess_end_time = sc_time();
 #endif
 
+  if (s->reqs != NULL) {
+    fprintf(stderr, "Warning: session ended with outstanding requests\n");
+  }
+
+  send_flush(s);
+
   sleep(1);
 
   for (role_idx=0; role_idx<role_count; role_idx++) {
     switch (s->roles[role_idx]->type) {
       case SESSION_ROLE_P2P:
         assert(s->roles[role_idx]->p2p != NULL);
-        if (zmq_close(s->roles[role_idx]->p2p->ptr)) {
-          perror("zmq_close");
+        if (s->roles[role_idx]->p2p->tp->close(s->roles[role_idx]->p2p) != 0) {
+          perror(s->roles[role_idx]->p2p->tp->name);
+        }
+        if (s->roles[role_idx]->p2p->rx != NULL) {
+          zmq_msg_close((zmq_msg_t *)s->roles[role_idx]->p2p->rx);
+          free(s->roles[role_idx]->p2p->rx);
+        }
+        for (held_idx=0; held_idx<s->roles[role_idx]->p2p->rx_nheld; held_idx++) {
+          zmq_msg_close((zmq_msg_t *)s->roles[role_idx]->p2p->rx_held + held_idx);
         }
+        free(s->roles[role_idx]->p2p->rx_held);
+        free(s->roles[role_idx]->p2p->rx_held_more);
+        sc_pool_free(s->roles[role_idx]->p2p->tx);
+        free(s->roles[role_idx]->p2p->host);
         break;
       case SESSION_ROLE_GRP:
+        if (s->roles[role_idx]->grp->in == NULL) { // Sub-group.
+          free(s->roles[role_idx]->grp->name);
+          free(s->roles[role_idx]->grp->endpoints);
+          free(s->roles[role_idx]->grp);
+          break;
+        }
         if (zmq_close(s->roles[role_idx]->grp->in->ptr) != 0) {
           perror("zmq_close");
         }
         if (zmq_close(s->roles[role_idx]->grp->out->ptr) != 0) {
           perror("zmq_close");
         }
+        if (s->roles[role_idx]->grp->in->rx != NULL) {
+          zmq_msg_close((zmq_msg_t *)s->roles[role_idx]->grp->in->rx);
+          free(s->roles[role_idx]->grp->in->rx);
+        }
         free(s->roles[role_idx]->grp->in);
         free(s->roles[role_idx]->grp->out);
         break;
@@ -356,6 +729,15 @@ void session_end(session *s)
   }
   free(s->roles);
 
+  for (role_idx=0; role_idx<s->nlabel; role_idx++) {
+    free(s->labels[role_idx]);
+  }
+  free(s->labels);
+  free(s->label_keys);
+  free(s->neighbours);
+  free(s->host);
+  shm_cleanup(s);
+
   zmq_term(s->ctx);
   s->r = NULL;
   free(s);
@@ -364,6 +746,9 @@ void session_end(session *s)
   printf("----- Statistics -----\n");
   printf("Total execution time (including session init and cleanup): %f sec\n", sc_time_diff(DEBUG_prog_start_time, DEBUG_prog_end_time));
   printf("Total time in session: %f sec\n", sc_time_diff(DEBUG_sess_start_time, DEBUG_sess_end_time));
+  if (DEBUG_alltoall_count > 0) {
+    printf("Total time in alltoall: %f sec (%d calls)\n", sc_time_diff(0, DEBUG_alltoall_time), DEBUG_alltoall_count);
+  }
   printf("----------------------\n");
 #endif
 }
@@ -378,6 +763,7 @@ void session_dump(const session *s)
   printf("\n------Session-------\n");
   printf("My role: %s\n", s->name);
   printf("Number of endpoint roles: %u\n", s->nrole);
+  printf("Number of message labels: %u\n", s->nlabel);
 
   for (endpoint_idx=0; endpoint_idx<endpoint_count; endpoint_idx++) {
     switch (s->roles[endpoint_idx]->type) {
@@ -393,9 +779,11 @@ void session_dump(const session *s)
         printf("Endpoint#%u { type: group, name: %s, endpoints: [\n",
           endpoint_idx,
           s->roles[endpoint_idx]->grp->name);
-        printf(" in { uri: %s }, out { uri: %s }\n",
-          s->roles[endpoint_idx]->grp->in->uri,
-          s->roles[endpoint_idx]->grp->out->uri);
+        if (s->roles[endpoint_idx]->grp->in != NULL) {
+          printf(" in { uri: %s }, out { uri: %s }\n",
+            s->roles[endpoint_idx]->grp->in->uri,
+            s->roles[endpoint_idx]->grp->out->uri);
+        }
         unsigned int grp_endpoint_idx;
         unsigned int grp_endpoint_count = s->roles[endpoint_idx]->grp->nendpoint;
         for (grp_endpoint_idx=0; grp_endpoint_idx<grp_endpoint_count; grp_endpoint_idx++) {
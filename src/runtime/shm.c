@@ -0,0 +1,269 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * shared memory broadcast module.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zmq.h>
+
+#include "sc/shm.h"
+
+#define SHM_BCAST_MIN (64 * 1024) // Bytes, broadcast through shared memory above.
+#define SHM_HDR_SIZE  64          // Segment header, payload starts cache line aligned.
+#define SHM_CACHE     8           // Segments kept mapped by a receiver.
+
+
+/**
+ * Segment header, the payload follows at SHM_HDR_SIZE.
+ */
+struct shm_hdr
+{
+  volatile int refs; // Receivers yet to release the payload.
+};
+
+/**
+ * Broadcast descriptor, published instead of the payload.
+ */
+struct shm_desc
+{
+  char name[32];
+  size_t cap;
+  size_t size;
+};
+
+/**
+ * A mapped segment.
+ */
+struct shm_seg
+{
+  char name[32];
+  char *base;
+  size_t cap;
+  int users;     // Received messages referencing the mapping.
+  int transient; // Not cached, unmapped when released.
+};
+
+struct shm_state
+{
+  struct shm_seg out; // Segment written by the local role.
+  struct shm_seg in[SHM_CACHE];
+  unsigned int next;
+};
+
+// Segment sequence, shared by every role (thread) of the process.
+static unsigned int shm_seq = 0;
+
+
+static struct shm_state *_state(session *s)
+{
+  if (s->shm == NULL) {
+    s->shm = calloc(1, sizeof(struct shm_state));
+  }
+  return (struct shm_state *)s->shm;
+}
+
+
+/**
+ * \brief Helper function to map a (new) segment.
+ *
+ */
+static char *_map(const char *name, size_t cap, int create)
+{
+  int fd;
+  void *base;
+
+  if ((fd = shm_open(name, create ? (O_CREAT | O_EXCL | O_RDWR) : O_RDWR, 0600)) < 0) {
+    perror(__FUNCTION__);
+    return NULL;
+  }
+  if (create && ftruncate(fd, cap) != 0) {
+    perror(__FUNCTION__);
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  base = mmap(NULL, cap, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    perror(__FUNCTION__);
+    if (create) shm_unlink(name);
+    return NULL;
+  }
+
+  return (char *)base;
+}
+
+
+/**
+ * \brief Helper function to release a received payload.
+ *
+ */
+static void _release(void *data, void *hint)
+{
+  struct shm_seg *seg = (struct shm_seg *)hint;
+
+  __sync_fetch_and_sub(&((struct shm_hdr *)seg->base)->refs, 1);
+  seg->users--;
+  if (seg->transient) {
+    munmap(seg->base, seg->cap);
+    free(seg);
+  }
+}
+
+
+int shm_bcast_eligible(const role *grp_role, size_t count)
+{
+  const session *s = grp_role->s;
+  int endpoint_idx;
+
+  if (grp_role->type != SESSION_ROLE_GRP || grp_role->grp->out == NULL) return 0;
+  if (sizeof(int) * count < SHM_BCAST_MIN) return 0;
+  if (s->host == NULL || grp_role->grp->nendpoint == 0) return 0;
+
+  for (endpoint_idx=0; endpoint_idx<grp_role->grp->nendpoint; ++endpoint_idx) {
+    if (grp_role->grp->endpoints[endpoint_idx]->host == NULL
+        || strcmp(grp_role->grp->endpoints[endpoint_idx]->host, s->host) != 0) return 0;
+  }
+
+  return 1;
+}
+
+
+int shm_bcast_int_array(const int arr[], size_t count, role *grp_role)
+{
+  int rc = 0;
+  struct shm_state *st = _state(grp_role->s);
+  struct shm_seg *seg = &st->out;
+  struct shm_desc desc;
+  size_t size = sizeof(int) * count;
+  zmq_msg_t msg;
+
+  if (st == NULL) return -1;
+
+  if (seg->base != NULL && __sync_fetch_and_add(&((struct shm_hdr *)seg->base)->refs, 0) != 0) {
+    return 1; // Previous broadcast still being read.
+  }
+
+  if (seg->base == NULL || seg->cap < SHM_HDR_SIZE + size) {
+    if (seg->base != NULL) {
+      munmap(seg->base, seg->cap);
+      shm_unlink(seg->name);
+    }
+    snprintf(seg->name, sizeof(seg->name), "/sessionc-%d-%u", (int)getpid(), __sync_fetch_and_add(&shm_seq, 1));
+    seg->cap = SHM_HDR_SIZE + size;
+    if ((seg->base = _map(seg->name, seg->cap, 1)) == NULL) return -1;
+  }
+
+#ifdef __DEBUG__
+  fprintf(stderr, " --> %s(%zu elements) {segment: %s}", __FUNCTION__, count, seg->name);
+#endif
+
+  memcpy(seg->base + SHM_HDR_SIZE, arr, size);
+  ((struct shm_hdr *)seg->base)->refs = grp_role->grp->nendpoint;
+  __sync_synchronize();
+
+  // Empty frame marks a descriptor.
+  memset(&desc, 0, sizeof(desc));
+  strcpy(desc.name, seg->name);
+  desc.cap = seg->cap;
+  desc.size = size;
+
+  zmq_msg_init_size(&msg, 0);
+  rc |= zmq_send(grp_role->grp->out->ptr, &msg, ZMQ_SNDMORE);
+  zmq_msg_close(&msg);
+  zmq_msg_init_size(&msg, sizeof(desc));
+  memcpy(zmq_msg_data(&msg), &desc, sizeof(desc));
+  rc |= zmq_send(grp_role->grp->out->ptr, &msg, 0);
+  zmq_msg_close(&msg);
+
+  if (rc != 0) {
+    perror(__FUNCTION__);
+    ((struct shm_hdr *)seg->base)->refs = 0; // Not published, nobody will release it.
+  }
+
+#ifdef __DEBUG__
+  fprintf(stderr, ".\n");
+#endif
+
+  return rc;
+}
+
+
+int shm_attach(void *msg, session *s)
+{
+  struct shm_state *st = _state(s);
+  struct shm_seg *seg = NULL;
+  struct shm_desc desc;
+  int seg_idx;
+
+  if (st == NULL) return -1;
+  if (zmq_msg_size((zmq_msg_t *)msg) != sizeof(desc)) {
+    fprintf(stderr, "%s: Invalid broadcast descriptor (%zu bytes)\n",
+        __FUNCTION__, zmq_msg_size((zmq_msg_t *)msg));
+    return -1;
+  }
+  memcpy(&desc, zmq_msg_data((zmq_msg_t *)msg), sizeof(desc));
+
+#ifdef __DEBUG__
+  fprintf(stderr, "{segment: %s} ", desc.name);
+#endif
+
+  for (seg_idx=0; seg_idx<SHM_CACHE; ++seg_idx) {
+    if (st->in[seg_idx].base != NULL && strcmp(st->in[seg_idx].name, desc.name) == 0) {
+      seg = &st->in[seg_idx];
+      break;
+    }
+  }
+
+  if (seg == NULL) { // Map the segment, evict an unused one.
+    for (seg_idx=0; seg_idx<SHM_CACHE; ++seg_idx) {
+      seg = &st->in[(st->next + seg_idx) % SHM_CACHE];
+      if (seg->users == 0) break;
+    }
+    if (seg->users == 0) {
+      st->next = (st->next + seg_idx + 1) % SHM_CACHE;
+      if (seg->base != NULL) munmap(seg->base, seg->cap);
+    } else { // Every cached segment is referenced.
+      seg = (struct shm_seg *)calloc(1, sizeof(struct shm_seg));
+      seg->transient = 1;
+    }
+    strcpy(seg->name, desc.name);
+    seg->cap = desc.cap;
+    if ((seg->base = _map(seg->name, seg->cap, 0)) == NULL) {
+      if (seg->transient) free(seg);
+      return -1;
+    }
+  }
+
+  seg->users++;
+  zmq_msg_close((zmq_msg_t *)msg);
+  return zmq_msg_init_data((zmq_msg_t *)msg, seg->base + SHM_HDR_SIZE, desc.size, _release, seg);
+}
+
+
+void shm_cleanup(session *s)
+{
+  struct shm_state *st = (struct shm_state *)s->shm;
+  int seg_idx;
+
+  if (st == NULL) return;
+
+  if (st->out.base != NULL) {
+    munmap(st->out.base, st->out.cap);
+    shm_unlink(st->out.name);
+  }
+  for (seg_idx=0; seg_idx<SHM_CACHE; ++seg_idx) {
+    if (st->in[seg_idx].base != NULL) munmap(st->in[seg_idx].base, st->in[seg_idx].cap);
+  }
+
+  free(st);
+  s->shm = NULL;
+}
@@ -0,0 +1,1082 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * raw TCP transport module.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include <zmq.h>
+
+#include "sc/pool.h"
+#include "sc/tcp.h"
+
+#define TCP_PARTS     16          // Message parts written together (queued: any number).
+#define TCP_RBUF      (64 * 1024) // Receive staging buffer.
+#define TCP_RETRY     10000       // Microseconds between connection attempts.
+#define URING_ENTRIES 256         // Submission queue entries (completions: twice).
+
+
+/**
+ * Frame header, followed by the frame payload.
+ */
+struct tcp_frame
+{
+  uint32_t size;
+  uint32_t more;
+};
+
+struct uring;
+
+struct tcp_conn
+{
+  session *s;
+  int fd;  // Connection (-1 until a server accepts).
+  int lfd; // Listening socket of a server (-1 once accepted).
+  int corked;
+  int more; // Last received frame is followed by another.
+
+  // Parts queued for sending (or held back for the ring), the first
+  // tx_off bytes of parts[0] (header and payload) are written out.
+  zmq_msg_t *parts;
+  struct tcp_frame *hdrs;
+  int nparts;
+  int maxparts;
+  size_t tx_off;
+
+  // Received bytes not yet consumed, from rpos to rlen.
+  char *rbuf;
+  size_t rpos;
+  size_t rlen;
+  int rx_err; // Error of a read in the background (errno).
+
+  // io_uring (transport_uring), null for plain sockets.
+  struct uring *ring;
+  void **owner; // Session field holding the ring.
+  int dirty;    // Listed for the next submission.
+
+  // Write in flight.
+  zmq_msg_t tx_parts[TCP_PARTS];
+  struct tcp_frame tx_hdrs[TCP_PARTS];
+  struct iovec tx_iov[2 * TCP_PARTS];
+  struct iovec *tx_pos;
+  int tx_iovcnt;
+  int tx_nparts;
+  int tx_busy;
+
+  // Read in flight.
+  struct iovec rx_iov[2];
+  int rx_busy;
+  int rx_async; // Read ahead into staging, not waited for.
+  int rx_res;
+};
+
+
+static int _wait_input(struct tcp_conn *conn);
+
+
+/**
+ * \brief Helper function to switch a socket to non-blocking mode or back.
+ *
+ */
+static void _nonblock(int fd, int on)
+{
+  int flags = fcntl(fd, F_GETFL, 0);
+
+  fcntl(fd, F_SETFL, on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK));
+}
+
+
+/**
+ * \brief Helper function to accept the client of a server endpoint.
+ *
+ */
+static int _accept(struct tcp_conn *conn)
+{
+  int one = 1;
+
+  while ((conn->fd = accept(conn->lfd, NULL, NULL)) < 0) {
+    if (errno != EINTR) {
+      perror(__FUNCTION__);
+      return -1;
+    }
+  }
+  close(conn->lfd);
+  conn->lfd = -1;
+  setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (conn->ring == NULL) _nonblock(conn->fd, 1); // io_uring would fail with EAGAIN instead.
+
+  return 0;
+}
+
+
+/**
+ * \brief Helper function to check for incoming data without blocking.
+ *
+ */
+static int _readable(int fd)
+{
+  struct pollfd pfd;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return poll(&pfd, 1, 0) > 0;
+}
+
+
+/**
+ * \brief Helper function to describe frames (headers and payloads).
+ *
+ * \returns Number of iovec entries used.
+ */
+static int _frame_iov(struct tcp_frame hdrs[], zmq_msg_t parts[], int nparts, struct iovec iov[])
+{
+  int iovcnt = 0;
+  int part_idx;
+
+  for (part_idx=0; part_idx<nparts; ++part_idx) {
+    iov[iovcnt].iov_base = &hdrs[part_idx];
+    iov[iovcnt].iov_len = sizeof(struct tcp_frame);
+    iovcnt++;
+    if (hdrs[part_idx].size > 0) {
+      iov[iovcnt].iov_base = zmq_msg_data(&parts[part_idx]);
+      iov[iovcnt].iov_len = hdrs[part_idx].size;
+      iovcnt++;
+    }
+  }
+
+  return iovcnt;
+}
+
+
+/**
+ * \brief Helper function to skip written bytes of an iovec array.
+ *
+ */
+static void _iov_advance(struct iovec **pos, int *iovcnt, size_t nbytes)
+{
+  while (*iovcnt > 0 && nbytes >= (*pos)->iov_len) {
+    nbytes -= (*pos)->iov_len;
+    (*pos)++;
+    (*iovcnt)--;
+  }
+  if (*iovcnt > 0) {
+    (*pos)->iov_base = (char *)(*pos)->iov_base + nbytes;
+    (*pos)->iov_len -= nbytes;
+  }
+}
+
+
+/**
+ * \brief Helper function to queue a message part for sending.
+ *
+ */
+static void _enqueue(struct tcp_conn *conn, zmq_msg_t *msg, int flags)
+{
+  int part_idx;
+
+  if (conn->nparts == conn->maxparts) {
+    conn->maxparts = (conn->maxparts == 0) ? TCP_PARTS : conn->maxparts * 2;
+    conn->parts = (zmq_msg_t *)realloc(conn->parts, sizeof(zmq_msg_t) * conn->maxparts);
+    conn->hdrs = (struct tcp_frame *)realloc(conn->hdrs, sizeof(struct tcp_frame) * conn->maxparts);
+  }
+
+  // Ownership moves to the transport, msg is left empty (as zmq_send).
+  part_idx = conn->nparts++;
+  zmq_msg_init(&conn->parts[part_idx]);
+  zmq_msg_move(&conn->parts[part_idx], msg);
+  conn->hdrs[part_idx].size = zmq_msg_size(&conn->parts[part_idx]);
+  conn->hdrs[part_idx].more = (flags & ZMQ_SNDMORE) != 0;
+}
+
+
+/**
+ * \brief Helper function to drop the first n (sent) parts of the queue.
+ *
+ */
+static void _dequeue(struct tcp_conn *conn, int n)
+{
+  // zmq_msg_t is moved by copying (as zmq_msg_move does).
+  memmove(conn->parts, conn->parts + n, sizeof(zmq_msg_t) * (conn->nparts - n));
+  memmove(conn->hdrs, conn->hdrs + n, sizeof(struct tcp_frame) * (conn->nparts - n));
+  conn->nparts -= n;
+}
+
+
+#ifdef __NR_io_uring_setup
+
+/**
+ * An io_uring shared by the endpoints of a session.
+ *
+ * Writes are held back and submitted together (send_flush(), or
+ * before the role waits), reads of all endpoints polled together are
+ * submitted at once, completions are reaped in bulk.
+ */
+struct uring
+{
+  int fd;
+  int refs; // Connections using the ring.
+
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  unsigned sq_entries, cq_entries;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_ptr, *cq_ptr;
+  size_t sq_size, cq_size;
+
+  unsigned nqueued;  // Queued, not submitted.
+  unsigned inflight; // Submitted, not completed.
+
+  // Connections with messages held back.
+  struct tcp_conn **dirty;
+  int ndirty;
+};
+
+static void _uring_reap(struct uring *ring);
+static void _uring_tx(struct tcp_conn *conn);
+
+
+static struct uring *_uring_init(void)
+{
+  struct io_uring_params params;
+  struct uring *ring = (struct uring *)calloc(1, sizeof(struct uring));
+  char *sq, *cq;
+
+  memset(&params, 0, sizeof(params));
+  if ((ring->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params)) < 0) {
+    free(ring);
+    return NULL;
+  }
+
+  ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cq_size > ring->sq_size) ring->sq_size = ring->cq_size;
+  }
+  ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    ring->cq_ptr = ring->sq_ptr;
+  } else {
+    ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+  }
+  ring->sqes = (struct io_uring_sqe *)mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sq_ptr == MAP_FAILED || ring->cq_ptr == MAP_FAILED || ring->sqes == MAP_FAILED) {
+    perror(__FUNCTION__);
+    close(ring->fd);
+    free(ring);
+    return NULL;
+  }
+
+  sq = (char *)ring->sq_ptr;
+  cq = (char *)ring->cq_ptr;
+  ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+  ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  ring->sq_entries = params.sq_entries;
+  ring->cq_entries = params.cq_entries;
+
+  return ring;
+}
+
+
+static void _uring_free(struct uring *ring)
+{
+  munmap(ring->sqes, ring->sq_entries * sizeof(struct io_uring_sqe));
+  if (ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_size);
+  munmap(ring->sq_ptr, ring->sq_size);
+  close(ring->fd);
+  free(ring->dirty);
+  free(ring);
+}
+
+
+/**
+ * \brief Helper function to submit queued operations.
+ *
+ * Completions are only reaped after waiting, otherwise they are left
+ * for the endpoints' poll (the ring fd stays readable).
+ *
+ * @param[in] ring Ring
+ * @param[in] wait Wait for a completion
+ */
+static void _uring_enter(struct uring *ring, int wait)
+{
+  int rc;
+
+  if (ring->nqueued > 0 || wait) {
+    rc = syscall(__NR_io_uring_enter, ring->fd, ring->nqueued, wait ? 1 : 0,
+        wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (rc > 0) {
+      ring->nqueued -= rc;
+      ring->inflight += rc;
+    } else if (rc < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      perror(__FUNCTION__);
+    }
+  }
+  if (wait) _uring_reap(ring);
+}
+
+
+/**
+ * \brief Helper function to queue an operation.
+ *
+ */
+static void _uring_queue(struct uring *ring, int opcode, int fd, uint64_t addr, unsigned len, uint64_t user_data)
+{
+  struct io_uring_sqe *sqe;
+  unsigned tail;
+
+  // Leave room in the completion queue for everything submitted.
+  while (*ring->sq_tail - *ring->sq_head >= ring->sq_entries
+      || ring->nqueued + ring->inflight >= ring->cq_entries) {
+    _uring_enter(ring, ring->nqueued == 0);
+  }
+
+  tail = *ring->sq_tail;
+  sqe = &ring->sqes[tail & *ring->sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->addr = addr;
+  sqe->len = len;
+  sqe->user_data = user_data;
+  ring->sq_array[tail & *ring->sq_mask] = tail & *ring->sq_mask;
+
+  __sync_synchronize();
+  *ring->sq_tail = tail + 1;
+  ring->nqueued++;
+}
+
+
+static void _uring_tx_done(struct tcp_conn *conn, int res)
+{
+  int part_idx;
+
+  if (res == -EINTR || res == -EAGAIN) {
+    res = 0; // Try again.
+  } else if (res < 0) {
+    fprintf(stderr, "%s: %s\n", __FUNCTION__, strerror(-res));
+    conn->tx_iovcnt = 0; // Message is lost.
+    res = 0;
+  }
+  _iov_advance(&conn->tx_pos, &conn->tx_iovcnt, res);
+
+  if (conn->tx_iovcnt > 0) { // Partial write, resume.
+    _uring_queue(conn->ring, IORING_OP_WRITEV, conn->fd, (uintptr_t)conn->tx_pos, conn->tx_iovcnt, (uintptr_t)conn);
+    return;
+  }
+
+  for (part_idx=0; part_idx<conn->tx_nparts; ++part_idx) {
+    zmq_msg_close(&conn->tx_parts[part_idx]);
+  }
+  conn->tx_nparts = 0;
+  conn->tx_busy = 0;
+  _uring_tx(conn); // Messages queued meanwhile, submitted with the next enter.
+}
+
+
+static void _uring_rx_done(struct tcp_conn *conn, int res)
+{
+  conn->rx_busy = 0;
+  conn->rx_res = res;
+  if (!conn->rx_async) return; // The reader accounts for the bytes.
+
+  if (res > 0) {
+    conn->rlen += res;
+  } else if (res == 0) {
+    conn->rx_err = ECONNRESET; // Peer closed the connection.
+  } else if (res != -EINTR && res != -EAGAIN && res != -ECANCELED) {
+    conn->rx_err = -res;
+  }
+}
+
+
+/**
+ * \brief Helper function to process completed operations.
+ *
+ */
+static void _uring_reap(struct uring *ring)
+{
+  struct io_uring_cqe cqes[URING_ENTRIES];
+  unsigned head, ncqe = 0;
+  unsigned cqe_idx;
+  uint64_t data;
+
+  // Copy completions out first, handlers may queue (and reap) again.
+  head = *ring->cq_head;
+  __sync_synchronize();
+  while (head != *ring->cq_tail && ncqe < URING_ENTRIES) {
+    cqes[ncqe++] = ring->cqes[head & *ring->cq_mask];
+    head++;
+  }
+  __sync_synchronize();
+  *ring->cq_head = head;
+  ring->inflight -= ncqe;
+
+  for (cqe_idx=0; cqe_idx<ncqe; ++cqe_idx) {
+    data = cqes[cqe_idx].user_data;
+    if (data == 0) continue; // Cancellation.
+    if (data & 1) {
+      _uring_rx_done((struct tcp_conn *)(uintptr_t)(data & ~(uint64_t)1), cqes[cqe_idx].res);
+    } else {
+      _uring_tx_done((struct tcp_conn *)(uintptr_t)data, cqes[cqe_idx].res);
+    }
+  }
+}
+
+
+/**
+ * \brief Helper function to queue a write of the messages held back for a connection.
+ *
+ * One write is in flight per connection, which keeps the stream in
+ * order; the rest waits for its completion without blocking the role.
+ */
+static void _uring_tx(struct tcp_conn *conn)
+{
+  int part_idx;
+
+  if (conn->tx_busy || conn->nparts == 0) return;
+
+  conn->tx_nparts = (conn->nparts < TCP_PARTS) ? conn->nparts : TCP_PARTS;
+  for (part_idx=0; part_idx<conn->tx_nparts; ++part_idx) {
+    zmq_msg_init(&conn->tx_parts[part_idx]);
+    zmq_msg_move(&conn->tx_parts[part_idx], &conn->parts[part_idx]);
+    conn->tx_hdrs[part_idx] = conn->hdrs[part_idx];
+  }
+  _dequeue(conn, conn->tx_nparts);
+  conn->tx_iovcnt = _frame_iov(conn->tx_hdrs, conn->tx_parts, conn->tx_nparts, conn->tx_iov);
+  conn->tx_pos = conn->tx_iov;
+  conn->tx_busy = 1;
+
+  _uring_queue(conn->ring, IORING_OP_WRITEV, conn->fd, (uintptr_t)conn->tx_pos, conn->tx_iovcnt, (uintptr_t)conn);
+}
+
+
+/**
+ * \brief Helper function to submit everything held back on a ring.
+ *
+ */
+static void _uring_flush(struct uring *ring)
+{
+  struct tcp_conn *conn;
+  int conn_idx, ndirty = 0;
+
+  for (conn_idx=0; conn_idx<ring->ndirty; ++conn_idx) {
+    conn = ring->dirty[conn_idx];
+    _uring_tx(conn);
+    if (conn->nparts > 0) { // Behind a write in flight.
+      ring->dirty[ndirty++] = conn;
+    } else {
+      conn->dirty = 0;
+    }
+  }
+  ring->ndirty = ndirty;
+  _uring_enter(ring, 0);
+}
+
+
+/**
+ * \brief Helper function to hold back a message for the next submission.
+ *
+ */
+static void _uring_send(struct tcp_conn *conn)
+{
+  if (conn->nparts >= TCP_PARTS) _uring_tx(conn); // Long run of sends.
+  if (conn->nparts > 0 && !conn->dirty) {
+    conn->dirty = 1;
+    conn->ring->dirty[conn->ring->ndirty++] = conn;
+  }
+}
+
+
+/**
+ * \brief Helper function to wait for the read in flight.
+ *
+ */
+static void _uring_rx_wait(struct tcp_conn *conn)
+{
+  while (conn->rx_busy) {
+    _uring_flush(conn->ring);
+    if (conn->rx_busy) _uring_enter(conn->ring, 1);
+  }
+}
+
+
+/**
+ * \brief Helper function to read into staging in the background.
+ *
+ */
+static void _uring_rx_async(struct tcp_conn *conn)
+{
+  if (conn->rx_busy || conn->rx_err) return;
+
+  if (conn->rpos > 0) {
+    memmove(conn->rbuf, conn->rbuf + conn->rpos, conn->rlen - conn->rpos);
+    conn->rlen -= conn->rpos;
+    conn->rpos = 0;
+  }
+  if (conn->rlen == TCP_RBUF) return;
+
+  conn->rx_iov[0].iov_base = conn->rbuf + conn->rlen;
+  conn->rx_iov[0].iov_len = TCP_RBUF - conn->rlen;
+  conn->rx_busy = 1;
+  conn->rx_async = 1;
+  _uring_queue(conn->ring, IORING_OP_READV, conn->fd, (uintptr_t)conn->rx_iov, 1, (uintptr_t)conn | 1);
+}
+
+
+/**
+ * \brief Helper function to read, submitting everything held back.
+ *
+ */
+static ssize_t _uring_read(struct tcp_conn *conn, const struct iovec *iov, int iovcnt)
+{
+  memcpy(conn->rx_iov, iov, sizeof(struct iovec) * iovcnt);
+  conn->rx_busy = 1;
+  conn->rx_async = 0;
+  _uring_queue(conn->ring, IORING_OP_READV, conn->fd, (uintptr_t)conn->rx_iov, iovcnt, (uintptr_t)conn | 1);
+  _uring_rx_wait(conn);
+
+  if (conn->rx_res < 0) {
+    errno = -conn->rx_res;
+    return -1;
+  }
+  return conn->rx_res;
+}
+
+
+static int _uring_fd(struct uring *ring)
+{
+  return ring->fd;
+}
+
+
+/**
+ * \brief Helper function to let a connection go of its ring.
+ *
+ */
+static void _uring_close(struct tcp_conn *conn)
+{
+  struct uring *ring = conn->ring;
+  int conn_idx;
+
+  while (conn->nparts > 0 || conn->tx_busy) { // Linger until sent.
+    _uring_tx(conn);
+    _uring_enter(ring, 1);
+  }
+  if (conn->rx_busy) { // Read ahead the peer will not satisfy.
+    _uring_queue(ring, IORING_OP_ASYNC_CANCEL, -1, (uintptr_t)conn | 1, 0, 0);
+    while (conn->rx_busy) _uring_enter(ring, 1);
+  }
+
+  for (conn_idx=0; conn_idx<ring->ndirty; ++conn_idx) {
+    if (ring->dirty[conn_idx] == conn) ring->dirty[conn_idx] = ring->dirty[--ring->ndirty];
+  }
+  if (--ring->refs == 0) {
+    _uring_free(ring);
+    *conn->owner = NULL;
+  }
+  conn->ring = NULL;
+}
+
+#else
+
+static struct uring *_uring_init(void) { return NULL; }
+static void _uring_reap(struct uring *ring) { }
+static int _uring_fd(struct uring *ring) { return -1; }
+static void _uring_flush(struct uring *ring) { }
+static void _uring_send(struct tcp_conn *conn) { }
+static void _uring_rx_wait(struct tcp_conn *conn) { }
+static void _uring_rx_async(struct tcp_conn *conn) { }
+static ssize_t _uring_read(struct tcp_conn *conn, const struct iovec *iov, int iovcnt) { return -1; }
+static void _uring_close(struct tcp_conn *conn) { }
+
+#endif // __NR_io_uring_setup
+
+
+/**
+ * \brief Helper function to read from a connection.
+ *
+ */
+static ssize_t _read_iov(struct tcp_conn *conn, const struct iovec *iov, int iovcnt)
+{
+  if (conn->ring != NULL) return _uring_read(conn, iov, iovcnt);
+  return readv(conn->fd, iov, iovcnt);
+}
+
+
+/**
+ * \brief Helper function to read until n bytes are staged.
+ *
+ */
+static int _fill(struct tcp_conn *conn, size_t n)
+{
+  struct iovec iov;
+  ssize_t nbytes;
+
+  if (conn->ring != NULL && conn->rlen - conn->rpos < n) {
+    _uring_rx_wait(conn); // Read ahead lands in staging.
+  }
+  if (conn->rlen - conn->rpos >= n) return 0;
+  if (conn->rx_err) {
+    errno = conn->rx_err;
+    return -1;
+  }
+
+  if (conn->rpos > 0) {
+    memmove(conn->rbuf, conn->rbuf + conn->rpos, conn->rlen - conn->rpos);
+    conn->rlen -= conn->rpos;
+    conn->rpos = 0;
+  }
+
+  while (conn->rlen < n) {
+    iov.iov_base = conn->rbuf + conn->rlen;
+    iov.iov_len = TCP_RBUF - conn->rlen;
+    nbytes = _read_iov(conn, &iov, 1);
+    if (nbytes > 0) {
+      conn->rlen += nbytes;
+    } else if (nbytes == 0) {
+      errno = ECONNRESET; // Peer closed the connection.
+      return -1;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      if (_wait_input(conn) != 0) return -1;
+    } else if (errno != EINTR) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+/**
+ * \brief Helper function to write out queued parts without blocking.
+ *
+ * \returns 0 if successful (parts may remain queued), -1 on error.
+ */
+static int _write_parts(struct tcp_conn *conn)
+{
+  struct iovec iov[2 * TCP_PARTS];
+  struct iovec *pos;
+  int nparts, iovcnt, part_idx;
+  size_t part_size;
+  ssize_t nbytes;
+
+  while (conn->nparts > 0) {
+    nparts = (conn->nparts < TCP_PARTS) ? conn->nparts : TCP_PARTS;
+    iovcnt = _frame_iov(conn->hdrs, conn->parts, nparts, iov);
+    pos = iov;
+    _iov_advance(&pos, &iovcnt, conn->tx_off); // Resume a partial write.
+    if ((nbytes = writev(conn->fd, pos, iovcnt)) < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+      return -1;
+    }
+
+    conn->tx_off += nbytes;
+    for (part_idx=0; part_idx<nparts; ++part_idx) {
+      part_size = sizeof(struct tcp_frame) + conn->hdrs[part_idx].size;
+      if (conn->tx_off < part_size) break;
+      conn->tx_off -= part_size;
+      zmq_msg_close(&conn->parts[part_idx]);
+    }
+    _dequeue(conn, part_idx);
+  }
+
+  return 0;
+}
+
+
+/**
+ * \brief Helper function to check if a plain socket connection has parts queued.
+ *
+ */
+static struct tcp_conn *_queued(struct role_endpoint *ep)
+{
+  struct tcp_conn *conn;
+
+  if (ep->tp != &transport_tcp && ep->tp != &transport_uring) return NULL;
+  if ((conn = (struct tcp_conn *)ep->ptr) == NULL) return NULL;
+  return (conn->ring == NULL && conn->fd >= 0 && conn->nparts > 0) ? conn : NULL;
+}
+
+
+/**
+ * \brief Helper function to wait for input on a plain socket.
+ *
+ * Parts queued on any connection of the session are written out
+ * meanwhile, the peers may need them before they send.
+ */
+static int _wait_input(struct tcp_conn *conn)
+{
+  struct pollfd pfds[1 + conn->s->nrole];
+  struct tcp_conn *conns[1 + conn->s->nrole];
+  struct tcp_conn *other;
+  unsigned role_idx;
+  int nfd = 1, fd_idx;
+
+  pfds[0].fd = conn->fd;
+  pfds[0].events = POLLIN | (conn->nparts > 0 ? POLLOUT : 0);
+  conns[0] = conn;
+  for (role_idx=0; role_idx<conn->s->nrole; ++role_idx) {
+    if (conn->s->roles[role_idx]->type != SESSION_ROLE_P2P) continue;
+    if ((other = _queued(conn->s->roles[role_idx]->p2p)) == NULL || other == conn) continue;
+    pfds[nfd].fd = other->fd;
+    pfds[nfd].events = POLLOUT;
+    conns[nfd++] = other;
+  }
+
+  while (poll(pfds, nfd, -1) < 0) {
+    if (errno != EINTR) return -1;
+  }
+  for (fd_idx=0; fd_idx<nfd; ++fd_idx) {
+    if ((pfds[fd_idx].revents & (POLLOUT | POLLERR | POLLHUP)) && conns[fd_idx]->nparts > 0) {
+      if (_write_parts(conns[fd_idx]) != 0 && fd_idx == 0) return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+static int _tcp_connect(struct role_endpoint *ep, session *s, const char *host, unsigned port, int server)
+{
+  struct tcp_conn *conn = (struct tcp_conn *)calloc(1, sizeof(struct tcp_conn));
+  struct sockaddr_in sin;
+  struct addrinfo hints, *res;
+  char service[8];
+  int one = 1;
+  int err = 0;
+
+  conn->s = s;
+  conn->fd = -1;
+  conn->lfd = -1;
+  conn->rbuf = (char *)malloc(TCP_RBUF);
+  ep->ptr = conn;
+
+  if (server) {
+    sprintf(ep->uri, "tcp://*:%u", port);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    sin.sin_port = htons(port);
+    if ((conn->lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+      perror(__FUNCTION__);
+      return -1;
+    }
+    setsockopt(conn->lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(conn->lfd, (struct sockaddr *)&sin, sizeof(sin)) != 0 || listen(conn->lfd, 1) != 0) {
+      perror(__FUNCTION__);
+      return -1;
+    }
+  } else {
+    sprintf(ep->uri, "tcp://%s:%u", host, port);
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    sprintf(service, "%u", port);
+    if (getaddrinfo(host, service, &hints, &res) != 0) {
+      fprintf(stderr, "%s: Cannot resolve %s\n", __FUNCTION__, host);
+      return -1;
+    }
+    // Servers listen before clients connect (session_init), retry until then.
+    for (;;) {
+      if ((conn->fd = socket(res->ai_family, SOCK_STREAM, 0)) < 0) {
+        err = errno;
+        break;
+      }
+      if (connect(conn->fd, res->ai_addr, res->ai_addrlen) == 0) break;
+      err = errno; // Before close() can change it.
+      close(conn->fd);
+      conn->fd = -1;
+      if (err != ECONNREFUSED && err != EINTR) break;
+      usleep(TCP_RETRY);
+    }
+    freeaddrinfo(res);
+    if (conn->fd < 0) {
+      errno = err;
+      perror(__FUNCTION__);
+      return -1;
+    }
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    _nonblock(conn->fd, 1);
+  }
+
+  return 0;
+}
+
+
+static int _uring_connect(struct role_endpoint *ep, session *s, const char *host, unsigned port, int server)
+{
+  static int unsupported = 0;
+  struct tcp_conn *conn;
+  struct uring *ring;
+
+  if (_tcp_connect(ep, s, host, port, server) != 0) return -1;
+  conn = (struct tcp_conn *)ep->ptr;
+
+  if (s->uring == NULL && !unsupported) {
+    if ((s->uring = _uring_init()) == NULL) {
+      fprintf(stderr, "%s: io_uring unavailable, using plain sockets\n", __FUNCTION__);
+      unsupported = 1;
+    }
+  }
+  if ((ring = (struct uring *)s->uring) == NULL) return 0;
+
+#ifdef __NR_io_uring_setup
+  ring->refs++;
+  ring->dirty = (struct tcp_conn **)realloc(ring->dirty, sizeof(struct tcp_conn *) * ring->refs);
+#endif
+  conn->ring = ring;
+  conn->owner = &s->uring;
+  if (conn->fd >= 0) _nonblock(conn->fd, 0); // The ring waits for the socket.
+
+  return 0;
+}
+
+
+static int _tcp_send(struct role_endpoint *ep, void *msg, int flags)
+{
+  struct tcp_conn *conn = (struct tcp_conn *)ep->ptr;
+#ifdef TCP_CORK
+  int one = 1;
+#endif
+
+  if (conn->fd < 0 && _accept(conn) != 0) return -1;
+
+  _enqueue(conn, (zmq_msg_t *)msg, flags);
+
+  if (conn->ring != NULL) { // Written with the next submission.
+    _uring_send(conn);
+    return 0;
+  }
+
+  if (flags & ZMQ_SNDMORE) return 0;
+
+#ifdef TCP_CORK
+  // Protocol sends a run of messages to the role, hold back partial segments.
+  if (ep->tx_hold && !conn->corked) {
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_CORK, &one, sizeof(one));
+    conn->corked = 1;
+  }
+#endif
+
+  // What the socket does not take stays queued, written out while
+  // the role waits (recv, poll, send_flush) or closes.
+  return _write_parts(conn);
+}
+
+
+static int _tcp_recv(struct role_endpoint *ep, void *msg, int flags)
+{
+  struct tcp_conn *conn = (struct tcp_conn *)ep->ptr;
+  struct tcp_frame frame;
+  struct iovec iov[2];
+  size_t copied;
+  ssize_t nbytes;
+  char *data;
+
+  if ((flags & ZMQ_NOBLOCK) && conn->rlen - conn->rpos < sizeof(frame)) {
+    if (conn->fd < 0 && _readable(conn->lfd) && _accept(conn) != 0) return -1;
+    if (conn->ring != NULL) _uring_reap(conn->ring);
+    if (conn->ring == NULL && conn->nparts > 0 && _write_parts(conn) != 0) return -1;
+    if (conn->rlen - conn->rpos < sizeof(frame) && !conn->rx_err
+        && (conn->fd < 0 || conn->rx_busy || !_readable(conn->fd))) {
+      errno = EAGAIN;
+      return -1;
+    }
+  }
+
+  if (conn->fd < 0 && _accept(conn) != 0) return -1;
+  if (_fill(conn, sizeof(frame)) != 0) return -1;
+
+  memcpy(&frame, conn->rbuf + conn->rpos, sizeof(frame));
+  conn->rpos += sizeof(frame);
+  conn->more = frame.more;
+
+  zmq_msg_close((zmq_msg_t *)msg);
+  if (frame.size == 0) {
+    return zmq_msg_init_size((zmq_msg_t *)msg, 0);
+  }
+  data = (char *)sc_pool_alloc(frame.size);
+
+  copied = conn->rlen - conn->rpos;
+  if (copied > frame.size) copied = frame.size;
+  memcpy(data, conn->rbuf + conn->rpos, copied);
+  conn->rpos += copied;
+
+  // Read the rest into the buffer, and whatever follows into staging.
+  while (copied < frame.size) {
+    conn->rpos = conn->rlen = 0;
+    iov[0].iov_base = data + copied;
+    iov[0].iov_len = frame.size - copied;
+    iov[1].iov_base = conn->rbuf;
+    iov[1].iov_len = TCP_RBUF;
+    if ((nbytes = _read_iov(conn, iov, 2)) <= 0) {
+      if (nbytes < 0 && errno == EINTR) continue;
+      if (nbytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && _wait_input(conn) == 0) continue;
+      if (nbytes == 0) errno = ECONNRESET;
+      sc_pool_free(data);
+      zmq_msg_init((zmq_msg_t *)msg);
+      return -1;
+    }
+    if ((size_t)nbytes > iov[0].iov_len) {
+      conn->rlen = nbytes - iov[0].iov_len;
+      copied = frame.size;
+    } else {
+      copied += nbytes;
+    }
+  }
+
+  return zmq_msg_init_data((zmq_msg_t *)msg, data, frame.size, sc_pool_free_fn, NULL);
+}
+
+
+static int _tcp_more(struct role_endpoint *ep)
+{
+  return ((struct tcp_conn *)ep->ptr)->more;
+}
+
+
+static int _tcp_poll(struct role_endpoint *ep, void *item, short events)
+{
+  struct tcp_conn *conn = (struct tcp_conn *)ep->ptr;
+
+  if (conn->ring != NULL) {
+    _uring_reap(conn->ring);
+  } else if (conn->nparts > 0 && _write_parts(conn) != 0) {
+    return 1; // Let the caller see the error.
+  }
+
+  if (events & ZMQ_POLLOUT) {
+    if (conn->nparts == 0 && !conn->tx_busy) return 1;
+    ((zmq_pollitem_t *)item)->socket = NULL;
+    if (conn->ring == NULL) { // Wait for room for the queued parts.
+      ((zmq_pollitem_t *)item)->fd = conn->fd;
+      ((zmq_pollitem_t *)item)->events = ZMQ_POLLOUT;
+      return 0;
+    }
+    // Held back or in flight (submitted by the flush before polling).
+    ((zmq_pollitem_t *)item)->fd = _uring_fd(conn->ring);
+    ((zmq_pollitem_t *)item)->events = ZMQ_POLLIN;
+    return 2;
+  }
+  if (conn->rlen - conn->rpos >= sizeof(struct tcp_frame) || conn->rx_err) return 1;
+
+  if (conn->fd < 0 && _readable(conn->lfd) && _accept(conn) != 0) return -1;
+  if (conn->fd < 0) return -1; // Client still connecting, check again.
+
+  ((zmq_pollitem_t *)item)->socket = NULL;
+  if (conn->ring != NULL) { // Read ahead, the ring signals completions.
+    _uring_rx_async(conn);
+    ((zmq_pollitem_t *)item)->fd = _uring_fd(conn->ring);
+    return 2;
+  }
+  ((zmq_pollitem_t *)item)->fd = conn->fd;
+  if (conn->nparts > 0) { // Keep writing out the queued parts while waiting.
+    if (_readable(conn->fd)) return 1;
+    ((zmq_pollitem_t *)item)->events = ZMQ_POLLIN | ZMQ_POLLOUT;
+    return 2;
+  }
+  return 0;
+}
+
+
+static int _tcp_flush(struct role_endpoint *ep)
+{
+  struct tcp_conn *conn = (struct tcp_conn *)ep->ptr;
+#ifdef TCP_CORK
+  int zero = 0;
+#endif
+
+  if (conn->ring != NULL) {
+    _uring_flush(conn->ring);
+    return 0;
+  }
+#ifdef TCP_CORK
+  if (conn->corked) { // Uncorking sends out partial segments.
+    conn->corked = 0;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_CORK, &zero, sizeof(zero));
+  }
+#endif
+  return (conn->nparts > 0) ? _write_parts(conn) : 0;
+}
+
+
+static int _tcp_close(struct role_endpoint *ep)
+{
+  struct tcp_conn *conn = (struct tcp_conn *)ep->ptr;
+  struct pollfd pfd;
+  int part_idx;
+
+  if (conn->ring != NULL) _uring_close(conn);
+
+  // Linger until the queued parts are written out (as ZeroMQ does).
+  while (_tcp_flush(ep) == 0 && conn->nparts > 0) {
+    pfd.fd = conn->fd;
+    pfd.events = POLLOUT;
+    poll(&pfd, 1, -1);
+  }
+  for (part_idx=0; part_idx<conn->nparts; ++part_idx) {
+    zmq_msg_close(&conn->parts[part_idx]);
+  }
+  free(conn->parts);
+  free(conn->hdrs);
+  if (conn->fd >= 0) close(conn->fd);
+  if (conn->lfd >= 0) close(conn->lfd);
+  free(conn->rbuf);
+  free(conn);
+  ep->ptr = NULL;
+
+  return 0;
+}
+
+
+const transport transport_tcp = {
+  "tcp",
+  _tcp_connect,
+  _tcp_send,
+  _tcp_recv,
+  _tcp_more,
+  _tcp_poll,
+  _tcp_close,
+  _tcp_flush
+};
+
+const transport transport_uring = {
+  "uring",
+  _uring_connect,
+  _tcp_send,
+  _tcp_recv,
+  _tcp_more,
+  _tcp_poll,
+  _tcp_close,
+  _tcp_flush
+};
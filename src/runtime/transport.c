@@ -0,0 +1,205 @@
+/**
+ * \file
+ * Session C runtime library (libsc)
+ * transport module.
+ */
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zmq.h>
+
+#include "sc/inproc.h"
+#include "sc/ring.h"
+#include "sc/tcp.h"
+#include "sc/transport.h"
+
+#define TRANSPORT_MAX 8 // Registered transports.
+
+
+static int _zmq_connect(struct role_endpoint *ep, session *s, const char *host, unsigned port, int server)
+{
+  if (strstr(host, "ipc:") != NULL) {
+    sprintf(ep->uri, "ipc:///tmp/sessionc-%u", port);
+  } else if (server) {
+    sprintf(ep->uri, "tcp://*:%u", port);
+  } else {
+    sprintf(ep->uri, "tcp://%s:%u", host, port);
+  }
+
+  if ((ep->ptr = zmq_socket(s->ctx, ZMQ_PAIR)) == NULL) {
+    perror("zmq_socket");
+    return -1;
+  }
+  if (server && zmq_bind(ep->ptr, ep->uri) != 0) {
+    perror("zmq_bind");
+    return -1;
+  }
+  if (!server && zmq_connect(ep->ptr, ep->uri) != 0) {
+    perror("zmq_connect");
+    return -1;
+  }
+
+  return 0;
+}
+
+
+static int _zmq_send(struct role_endpoint *ep, void *msg, int flags)
+{
+  return zmq_send(ep->ptr, (zmq_msg_t *)msg, flags);
+}
+
+
+static int _zmq_recv(struct role_endpoint *ep, void *msg, int flags)
+{
+  return zmq_recv(ep->ptr, (zmq_msg_t *)msg, flags);
+}
+
+
+static int _zmq_more(struct role_endpoint *ep)
+{
+  int64_t more = 0;
+  size_t more_size = sizeof(more);
+
+  if (zmq_getsockopt(ep->ptr, ZMQ_RCVMORE, &more, &more_size) != 0) return 0;
+  return (more != 0);
+}
+
+
+static int _zmq_poll(struct role_endpoint *ep, void *item, short events)
+{
+  ((zmq_pollitem_t *)item)->socket = ep->ptr;
+  ((zmq_pollitem_t *)item)->fd = 0;
+  return 0;
+}
+
+
+static int _zmq_close(struct role_endpoint *ep)
+{
+  return zmq_close(ep->ptr);
+}
+
+
+const transport transport_zmq = {
+  "zmq",
+  _zmq_connect,
+  _zmq_send,
+  _zmq_recv,
+  _zmq_more,
+  _zmq_poll,
+  _zmq_close,
+  NULL
+};
+
+static const transport *transports[TRANSPORT_MAX] = { &transport_zmq, &transport_shm, &transport_inproc, &transport_tcp, &transport_uring };
+static int ntransport = 5;
+
+
+int transport_register(const transport *tp)
+{
+  if (ntransport == TRANSPORT_MAX) {
+    fprintf(stderr, "%s: Cannot register transport %s, too many transports\n", __FUNCTION__, tp->name);
+    return -1;
+  }
+  transports[ntransport++] = tp;
+  return 0;
+}
+
+
+const transport *transport_select(const char *host, const char **addr)
+{
+  int tp_idx;
+  size_t len;
+
+  for (tp_idx=0; tp_idx<ntransport; ++tp_idx) {
+    len = strlen(transports[tp_idx]->name);
+    if (strncmp(host, transports[tp_idx]->name, len) == 0 && host[len] == ':') {
+      *addr = host + len + 1;
+      return transports[tp_idx];
+    }
+  }
+
+  *addr = host;
+  return &transport_zmq;
+}
+
+
+int transport_poll(struct role_endpoint *eps[], const short events[], short revents[], int n, long timeout)
+{
+  int idx, item_idx;
+  int nready, nitem, nspin, recheck;
+  long slice = 0, waited = 0;
+  zmq_pollitem_t items[n > 0 ? n : 1];
+  int item_ep[n > 0 ? n : 1];
+  int item_recheck[n > 0 ? n : 1];
+
+  for (;;) {
+    nready = nitem = nspin = 0;
+    for (idx=0; idx<n; ++idx) {
+      revents[idx] = 0;
+      items[nitem].events = events[idx];
+      items[nitem].revents = 0;
+      switch (eps[idx]->tp->poll(eps[idx], &items[nitem], events[idx])) {
+        case 0:
+          item_recheck[nitem] = 0;
+          item_ep[nitem++] = idx;
+          break;
+        case 2:
+          item_recheck[nitem] = 1;
+          item_ep[nitem++] = idx;
+          break;
+        case -1:
+          nspin++;
+          break;
+        default:
+          revents[idx] = events[idx];
+      }
+      if (revents[idx] == 0 && (events[idx] & ZMQ_POLLIN) && (eps[idx]->rx_pending || eps[idx]->rx_parts > 0 || eps[idx]->rx_nheld > 0)) {
+        revents[idx] = ZMQ_POLLIN;
+      }
+      nready += (revents[idx] != 0);
+    }
+    if (nready > 0) return nready;
+
+    // Only sockets and fds, zmq_poll waits for all of them.
+    if (nspin == 0 || timeout == 0) slice = timeout;
+    else if (timeout > 0 && slice > timeout - waited) slice = timeout - waited;
+
+    // Submit what the transports hold back (batched per io_uring) before waiting.
+    for (idx=0; idx<n; ++idx) {
+      if (eps[idx]->tp->flush != NULL) eps[idx]->tp->flush(eps[idx]);
+    }
+
+    if (nitem > 0) {
+      if (zmq_poll(items, nitem, slice) < 0) {
+        perror(__FUNCTION__);
+        return -1;
+      }
+      recheck = 0;
+      for (item_idx=0; item_idx<nitem; ++item_idx) {
+        if (item_recheck[item_idx]) { // Completions, not necessarily for this endpoint.
+          recheck |= (items[item_idx].revents != 0);
+          continue;
+        }
+        revents[item_ep[item_idx]] = items[item_idx].revents & events[item_ep[item_idx]];
+        nready += (revents[item_ep[item_idx]] != 0);
+      }
+      if (nready > 0) return nready;
+      if (recheck) continue;
+    } else if (slice > 0) {
+      usleep(slice);
+    } else {
+      sched_yield();
+    }
+
+    if (nspin == 0 || timeout == 0) return 0;
+    waited += slice;
+    if (timeout > 0 && waited >= timeout) return 0;
+
+    // Back off from rechecking the rings, up to 1ms between checks.
+    slice = (slice == 0) ? 1 : (slice < 1000 ? slice * 2 : 1000);
+  }
+}
@@ -25,6 +25,17 @@ double sc_time_diff(long long t0, long long t1)
 }
 
 
+unsigned int sc_label_hash(const char *label)
+{
+  unsigned int hash = 2166136261u;
+  while (*label != '\0') {
+    hash ^= (unsigned char)*label++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+
 void sc_print_version()
 {
   printf("Session C runtime library (version %d.%d.%d)\n",
@@ -453,7 +453,8 @@ namespace {
             // ---------- End of Receive/Recv ----------
 
             // ---------- Receive label ----------
-            if (func_name.compare("probe_label") == 0) {
+            if (func_name.compare("probe_label") == 0
+                || func_name.compare("probe_label_id") == 0) {
 
               std::string payload("__LABEL__");
 
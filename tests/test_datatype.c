@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sc/datatype.h"
+#include "sc/types.h"
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Console.h>
+
+#define N 256 // Integers in a test array.
+
+
+int setup_suite(void)
+{
+  return 0;
+}
+
+
+int teardown_suite(void)
+{
+  return 0;
+}
+
+
+/**
+ * Pack arr[i] = i through type and unpack it again, the packed
+ * buffer must hold the n elements at idx (in order) and the
+ * unpacked array those elements only.
+ */
+int roundtrip(const datatype *type, const size_t idx[], size_t n)
+{
+  int arr[N], buf[N], out[N];
+  size_t i;
+  int ok = (type->size == n);
+
+  for (i=0; i<N; ++i) {
+    arr[i] = i;
+    buf[i] = -1;
+    out[i] = -1;
+  }
+
+  datatype_pack(arr, type, buf);
+  for (i=0; i<n; ++i) {
+    ok &= (buf[i] == (int)idx[i]);
+  }
+  ok &= (n == N || buf[n] == -1);
+
+  datatype_unpack(buf, type, out);
+  for (i=0; i<n; ++i) {
+    ok &= (out[idx[i]] == (int)idx[i]);
+    out[idx[i]] = -1;
+  }
+  for (i=0; i<N; ++i) {
+    ok &= (out[i] == -1);
+  }
+
+  return ok;
+}
+
+
+/**
+ * Element indices of count blocks of blocklen, stride apart.
+ */
+size_t vector_idx(size_t count, size_t blocklen, size_t stride, size_t idx[])
+{
+  size_t i, j, n = 0;
+  for (i=0; i<count; ++i) {
+    for (j=0; j<blocklen; ++j) idx[n++] = i * stride + j;
+  }
+  return n;
+}
+
+
+void test_vector(void)
+{
+  datatype *type;
+  size_t idx[N], n;
+
+  // Equally spaced pairs.
+  CU_ASSERT(0 == datatype_vector(4, 2, 5, &type));
+  CU_ASSERT(SC_DTYPE_VECTOR == type->kind);
+  CU_ASSERT(type->count == 4 && type->blocklen == 2 && type->stride == 5);
+  n = vector_idx(4, 2, 5, idx);
+  CU_ASSERT(roundtrip(type, idx, n));
+  datatype_free(&type);
+  CU_ASSERT(NULL == type);
+
+  // A matrix column (single element gather).
+  CU_ASSERT(0 == datatype_vector(20, 1, 12, &type));
+  CU_ASSERT(SC_DTYPE_VECTOR == type->kind);
+  CU_ASSERT(type->blocklen == 1 && type->stride == 12);
+  n = vector_idx(20, 1, 12, idx);
+  CU_ASSERT(roundtrip(type, idx, n));
+  datatype_free(&type);
+
+  // Odd block length.
+  CU_ASSERT(0 == datatype_vector(6, 5, 9, &type));
+  CU_ASSERT(SC_DTYPE_VECTOR == type->kind);
+  n = vector_idx(6, 5, 9, idx);
+  CU_ASSERT(roundtrip(type, idx, n));
+  datatype_free(&type);
+
+  // Blocks as far apart as they are long are one block.
+  CU_ASSERT(0 == datatype_vector(8, 4, 4, &type));
+  CU_ASSERT(SC_DTYPE_CONTIG == type->kind);
+  CU_ASSERT(type->offset == 0 && type->size == 32);
+  n = vector_idx(8, 4, 4, idx);
+  CU_ASSERT(roundtrip(type, idx, n));
+  datatype_free(&type);
+
+  // A single block.
+  CU_ASSERT(0 == datatype_vector(1, 7, 100, &type));
+  CU_ASSERT(SC_DTYPE_CONTIG == type->kind);
+  n = vector_idx(1, 7, 100, idx);
+  CU_ASSERT(roundtrip(type, idx, n));
+  datatype_free(&type);
+}
+
+
+void test_indexed(void)
+{
+  const size_t lens_irregular[] = { 2, 3, 1 }, displs_irregular[] = { 1, 5, 12 };
+  const size_t idx_irregular[] = { 1, 2, 5, 6, 7, 12 };
+  const size_t lens_uniform[] = { 2, 2, 2 }, displs_uniform[] = { 0, 3, 10 };
+  const size_t idx_uniform[] = { 0, 1, 3, 4, 10, 11 };
+  const size_t lens_regular[] = { 2, 2, 2 }, displs_regular[] = { 1, 4, 7 };
+  const size_t idx_regular[] = { 1, 2, 4, 5, 7, 8 };
+  const size_t lens_adjacent[] = { 2, 0, 3, 1 }, displs_adjacent[] = { 8, 30, 10, 13 };
+  const size_t idx_adjacent[] = { 8, 9, 10, 11, 12, 13 };
+  const size_t lens_reversed[] = { 2, 2 }, displs_reversed[] = { 20, 4 };
+  const size_t idx_reversed[] = { 20, 21, 4, 5 };
+  datatype *type;
+
+  // Blocks of different lengths.
+  CU_ASSERT(0 == datatype_indexed(3, lens_irregular, displs_irregular, &type));
+  CU_ASSERT(SC_DTYPE_INDEXED == type->kind);
+  CU_ASSERT(type->count == 3 && type->blocklen == 0 && type->blocklens != NULL);
+  CU_ASSERT(roundtrip(type, idx_irregular, 6));
+  datatype_free(&type);
+
+  // Blocks of one length, unequally spaced.
+  CU_ASSERT(0 == datatype_indexed(3, lens_uniform, displs_uniform, &type));
+  CU_ASSERT(SC_DTYPE_INDEXED == type->kind);
+  CU_ASSERT(type->blocklen == 2 && type->blocklens == NULL);
+  CU_ASSERT(roundtrip(type, idx_uniform, 6));
+  datatype_free(&type);
+
+  // Blocks of one length, equally spaced.
+  CU_ASSERT(0 == datatype_indexed(3, lens_regular, displs_regular, &type));
+  CU_ASSERT(SC_DTYPE_VECTOR == type->kind);
+  CU_ASSERT(type->offset == 1 && type->blocklen == 2 && type->stride == 3);
+  CU_ASSERT(roundtrip(type, idx_regular, 6));
+  datatype_free(&type);
+
+  // Adjacent blocks merged, empty blocks dropped.
+  CU_ASSERT(0 == datatype_indexed(4, lens_adjacent, displs_adjacent, &type));
+  CU_ASSERT(SC_DTYPE_CONTIG == type->kind);
+  CU_ASSERT(type->offset == 8 && type->size == 6);
+  CU_ASSERT(roundtrip(type, idx_adjacent, 6));
+  datatype_free(&type);
+
+  // Blocks out of order keep their order.
+  CU_ASSERT(0 == datatype_indexed(2, lens_reversed, displs_reversed, &type));
+  CU_ASSERT(SC_DTYPE_INDEXED == type->kind);
+  CU_ASSERT(roundtrip(type, idx_reversed, 4));
+  datatype_free(&type);
+}
+
+
+void test_subarray(void)
+{
+  const size_t sizes2[] = { 12, 16 }, sizes3[] = { 4, 6, 8 };
+  const size_t block[] = { 3, 4 }, block_start[] = { 2, 5 };
+  const size_t rows[] = { 4, 16 }, rows_start[] = { 6, 0 };
+  const size_t cube[] = { 2, 3, 2 }, cube_start[] = { 1, 2, 5 };
+  const size_t outside[] = { 4, 4 }, outside_start[] = { 10, 0 };
+  size_t idx[N], n = 0;
+  size_t i, j, k;
+  datatype *type;
+
+  // A sub-block of a matrix.
+  CU_ASSERT(0 == datatype_subarray(2, sizes2, block, block_start, &type));
+  CU_ASSERT(SC_DTYPE_VECTOR == type->kind);
+  CU_ASSERT(type->offset == 2 * 16 + 5 && type->blocklen == 4 && type->stride == 16);
+  for (i=0; i<3; ++i) {
+    for (j=0; j<4; ++j) idx[n++] = (2 + i) * 16 + 5 + j;
+  }
+  CU_ASSERT(roundtrip(type, idx, n));
+  datatype_free(&type);
+
+  // Whole rows of a matrix.
+  CU_ASSERT(0 == datatype_subarray(2, sizes2, rows, rows_start, &type));
+  CU_ASSERT(SC_DTYPE_CONTIG == type->kind);
+  CU_ASSERT(type->offset == 6 * 16 && type->size == 4 * 16);
+  for (n=0; n<4*16; ++n) idx[n] = 6 * 16 + n;
+  CU_ASSERT(roundtrip(type, idx, n));
+  datatype_free(&type);
+
+  // A sub-cube: rows equally spaced within a plane, not across planes.
+  CU_ASSERT(0 == datatype_subarray(3, sizes3, cube, cube_start, &type));
+  CU_ASSERT(SC_DTYPE_INDEXED == type->kind);
+  CU_ASSERT(type->count == 6 && type->blocklen == 2 && type->blocklens == NULL);
+  n = 0;
+  for (i=0; i<2; ++i) {
+    for (j=0; j<3; ++j) {
+      for (k=0; k<2; ++k) idx[n++] = ((1 + i) * 6 + 2 + j) * 8 + 5 + k;
+    }
+  }
+  CU_ASSERT(roundtrip(type, idx, n));
+  datatype_free(&type);
+
+  // Out of bounds.
+  type = NULL;
+  CU_ASSERT(-1 == datatype_subarray(2, sizes2, outside, outside_start, &type));
+  CU_ASSERT(-1 == datatype_subarray(0, sizes2, block, block_start, &type));
+  CU_ASSERT(NULL == type);
+}
+
+
+int main(int argc, char *argv[])
+{
+  CU_pSuite suite = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  suite = CU_add_suite("Session C derived datatypes", setup_suite, teardown_suite);
+
+  if (NULL == suite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (NULL == CU_add_test(suite, "Vector", &test_vector)
+      || NULL == CU_add_test(suite, "Indexed", &test_indexed)
+      || NULL == CU_add_test(suite, "Subarray", &test_subarray)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  CU_console_run_tests();
+  CU_cleanup_registry();
+
+  return CU_get_error();
+}
@@ -0,0 +1,272 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zmq.h>
+
+#include "sc/inproc.h"
+#include "sc/primitives.h"
+#include "sc/transport.h"
+#include "sc/types.h"
+#include "sc/utils.h"
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Console.h>
+
+#define ITERS 100000
+
+
+session s;
+struct role_endpoint ep_a, ep_b;
+role role_a, role_b;
+char *labels[] = { "Label" };
+unsigned int label_keys[1];
+
+int setup_inprocsuite(void)
+{
+  // Two roles of a hand-made session connected over an in-process channel.
+  memset(&s, 0, sizeof(session));
+  label_keys[0] = sc_label_hash(labels[0]);
+  s.nlabel = 1;
+  s.labels = labels;
+  s.label_keys = label_keys;
+  memset(&ep_a, 0, sizeof(struct role_endpoint));
+  memset(&ep_b, 0, sizeof(struct role_endpoint));
+
+  ep_a.tp = &transport_inproc;
+  ep_b.tp = &transport_inproc;
+  if (transport_inproc.connect(&ep_a, &s, "test_inproc", 7777, 1) != 0) return -1;
+  if (transport_inproc.connect(&ep_b, &s, "test_inproc", 7777, 0) != 0) return -1;
+
+  role_a.s = &s;
+  role_a.type = SESSION_ROLE_P2P;
+  role_a.p2p = &ep_a;
+  role_b.s = &s;
+  role_b.type = SESSION_ROLE_P2P;
+  role_b.p2p = &ep_b;
+
+  return 0;
+}
+
+
+int teardown_inprocsuite(void)
+{
+  transport_inproc.close(&ep_a);
+  transport_inproc.close(&ep_b);
+  return 0;
+}
+
+
+void test_select(void)
+{
+  const char *addr;
+
+  CU_ASSERT(&transport_inproc == transport_select("inproc:test", &addr));
+  CU_ASSERT(strcmp(addr, "test") == 0);
+  CU_ASSERT(&transport_zmq == transport_select("localhost", &addr));
+}
+
+
+void test_poll(void)
+{
+  struct role_endpoint *eps[] = { &ep_b };
+  short events[] = { ZMQ_POLLIN };
+  short revents[1];
+  int sbuf[4] = { 1, 2, 3, 4 }, rbuf[4];
+  size_t count = 4;
+
+  CU_ASSERT(0 == transport_poll(eps, events, revents, 1, 0));
+  CU_ASSERT(0 == transport_poll(eps, events, revents, 1, 1000)); // Times out.
+  send_int_array(sbuf, 4, &role_a, NULL);
+  CU_ASSERT(1 == transport_poll(eps, events, revents, 1, -1));
+  CU_ASSERT(ZMQ_POLLIN == revents[0]);
+  recv_int_array(rbuf, &count, &role_b);
+  CU_ASSERT(count == 4 && memcmp(sbuf, rbuf, sizeof(sbuf)) == 0);
+}
+
+
+void *pong(void *arg)
+{
+  int buf[1024];
+  size_t count;
+  int i;
+
+  for (i=0; i<ITERS; ++i) {
+    count = 1024;
+    recv_int_array(buf, &count, &role_b);
+    send_int_array(buf, count, &role_b, NULL);
+  }
+  return NULL;
+}
+
+
+void test_pingpong(void)
+{
+  int sbuf[1024], rbuf[1024];
+  size_t count;
+  pthread_t thread;
+  int i, ok = 1;
+
+  pthread_create(&thread, NULL, pong, NULL);
+  for (i=0; i<ITERS; ++i) {
+    sbuf[0] = i;
+    send_int_array(sbuf, (i % 1024) + 1, &role_a, NULL);
+    count = 1024;
+    recv_int_array(rbuf, &count, &role_a);
+    ok &= (rbuf[0] == i && count == (size_t)(i % 1024) + 1);
+  }
+  pthread_join(thread, NULL);
+  CU_ASSERT(ok);
+}
+
+
+/**
+ * Wait until the messages queued on an end are in the channel.
+ */
+void wait_sent(struct role_endpoint *ep)
+{
+  short events = ZMQ_POLLOUT, revents;
+
+  transport_poll(&ep, &events, &revents, 1, -1);
+}
+
+
+void *stream(void *arg)
+{
+  int i;
+
+  for (i=0; i<ITERS; ++i) {
+    send_int(i, &role_a, NULL);
+  }
+  wait_sent(&ep_a);
+  return NULL;
+}
+
+
+void test_stream(void)
+{
+  pthread_t thread;
+  int i, val, ok = 1;
+
+  // More messages than queue slots, the rest are queued on the sender.
+  pthread_create(&thread, NULL, stream, NULL);
+  for (i=0; i<ITERS; ++i) {
+    recv_int(&val, &role_b);
+    ok &= (val == i);
+  }
+  pthread_join(thread, NULL);
+  CU_ASSERT(ok);
+}
+
+
+void *overflow(void *arg)
+{
+  int i, val, ok = 1;
+
+  for (i=0; i<ITERS; ++i) {
+    send_int(i, &role_b, NULL);
+  }
+  for (i=0; i<ITERS; ++i) {
+    recv_int(&val, &role_b);
+    ok &= (val == i);
+  }
+  wait_sent(&ep_b);
+  return ok ? arg : NULL;
+}
+
+
+void test_overflow(void)
+{
+  pthread_t thread;
+  void *ok;
+  int i, val, all = 1;
+
+  // Both ends send more messages than queue slots before receiving.
+  pthread_create(&thread, NULL, overflow, &all);
+  for (i=0; i<ITERS; ++i) {
+    send_int(i, &role_a, NULL);
+  }
+  for (i=0; i<ITERS; ++i) {
+    recv_int(&val, &role_a);
+    all &= (val == i);
+  }
+  wait_sent(&ep_a);
+  pthread_join(thread, &ok);
+  CU_ASSERT(all && ok == &all);
+}
+
+
+void test_tokens(void)
+{
+  int sbuf[2] = { 1, 2 }, rbuf[2];
+  int *nocopy = (int *)malloc(sizeof(int));
+  size_t count = 2;
+  int label_id;
+
+  // A receive skips the token, it is left to recv_token().
+  CU_ASSERT(0 == send_token(&role_a));
+  CU_ASSERT(0 == send_int_array(sbuf, 2, &role_a, NULL));
+  CU_ASSERT(0 == recv_int_array(rbuf, &count, &role_b));
+  CU_ASSERT(count == 2 && rbuf[0] == 1 && rbuf[1] == 2);
+  CU_ASSERT(0 == recv_token(&role_b));
+
+  // A message ahead of the token is held back, empty ones too.
+  CU_ASSERT(0 == send_int_array(sbuf, 0, &role_a, NULL));
+  CU_ASSERT(0 == send_token(&role_a));
+  CU_ASSERT(0 == recv_token(&role_b));
+  count = 2;
+  CU_ASSERT(0 == recv_int_array(rbuf, &count, &role_b));
+  CU_ASSERT(count == 0);
+
+  // Any number of messages ahead of the token are held back in order,
+  // labels sent as frames of their own (without copying) too.
+  *nocopy = 3;
+  CU_ASSERT(0 == send_int_array(sbuf, 1, &role_a, NULL));
+  CU_ASSERT(0 == send_int_array(sbuf, 2, &role_a, "Label"));
+  CU_ASSERT(0 == send_int_array_nocopy(nocopy, 1, &role_a, "Label", NULL, NULL));
+  CU_ASSERT(0 == send_token(&role_a));
+  CU_ASSERT(0 == recv_token(&role_b));
+  count = 2;
+  CU_ASSERT(0 == recv_int_array(rbuf, &count, &role_b));
+  CU_ASSERT(count == 1 && rbuf[0] == 1);
+  CU_ASSERT(0 == probe_label_id(&label_id, &role_b));
+  count = 2;
+  CU_ASSERT(0 == recv_int_array(rbuf, &count, &role_b));
+  CU_ASSERT(label_id == 0 && count == 2 && rbuf[0] == 1 && rbuf[1] == 2);
+  CU_ASSERT(0 == probe_label_id(&label_id, &role_b));
+  count = 2;
+  CU_ASSERT(0 == recv_int_array(rbuf, &count, &role_b));
+  CU_ASSERT(label_id == 0 && count == 1 && rbuf[0] == 3);
+}
+
+
+int main(int argc, char *argv[])
+{
+  CU_pSuite inprocsuite = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  inprocsuite = CU_add_suite("Session C in-process channels", setup_inprocsuite, teardown_inprocsuite);
+
+  if (NULL == inprocsuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ((NULL == CU_add_test(inprocsuite, "Transport selection", &test_select)) ||
+      (NULL == CU_add_test(inprocsuite, "Poll",                &test_poll)) ||
+      (NULL == CU_add_test(inprocsuite, "Ping-pong",           &test_pingpong)) ||
+      (NULL == CU_add_test(inprocsuite, "Stream",              &test_stream)) ||
+      (NULL == CU_add_test(inprocsuite, "Overflow",            &test_overflow)) ||
+      (NULL == CU_add_test(inprocsuite, "Barrier tokens",      &test_tokens))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  CU_console_run_tests();
+  CU_cleanup_registry();
+
+  return CU_get_error();
+}
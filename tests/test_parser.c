@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "st_node.h"
@@ -59,6 +60,40 @@ void test_empty_local(void)
 }
 
 
+void test_local_choice(void)
+{
+  char *filename = "examples/parser/LocalChoice.spr";
+  CU_ASSERT(NULL != (yyin = fopen(filename, "r")));
+
+  tree = st_tree_init((st_tree *)malloc(sizeof(st_tree)));
+  yyparse();
+  CU_ASSERT(tree->info->global == 0);
+
+  // Branches and the choice role are kept (labels are collected from them).
+  CU_ASSERT(tree->root->nchild == 1);
+  st_node *choice = tree->root->children[0];
+  CU_ASSERT(choice->type == ST_NODE_CHOICE);
+  CU_ASSERT(strcmp(choice->choice->at, "A") == 0);
+  CU_ASSERT(choice->nchild == 3);
+
+  CU_ASSERT(choice->children[0]->type == ST_NODE_ROOT);
+  CU_ASSERT(choice->children[0]->nchild == 1);
+  CU_ASSERT(choice->children[0]->children[0]->type == ST_NODE_SEND);
+  CU_ASSERT(strcmp(choice->children[0]->children[0]->interaction->msgsig.op, "Add") == 0);
+
+  CU_ASSERT(choice->children[1]->type == ST_NODE_ROOT);
+  CU_ASSERT(choice->children[1]->nchild == 2);
+  CU_ASSERT(strcmp(choice->children[1]->children[0]->interaction->msgsig.op, "Sub") == 0);
+  CU_ASSERT(choice->children[1]->children[1]->type == ST_NODE_RECV);
+
+  CU_ASSERT(choice->children[2]->type == ST_NODE_ROOT);
+  CU_ASSERT(choice->children[2]->nchild == 0);
+
+  free(tree);
+  CU_ASSERT(0 == fclose(yyin));
+}
+
+
 int main(int argc, char *argv[])
 {
   CU_pSuite parsersuite = NULL;
@@ -74,7 +109,8 @@ int main(int argc, char *argv[])
   }
 
   if ((NULL == CU_add_test(parsersuite, "Empty Global protocol", &test_empty_global)) ||
-      (NULL == CU_add_test(parsersuite, "Empty Local protocol",  &test_empty_local))) {
+      (NULL == CU_add_test(parsersuite, "Empty Local protocol",  &test_empty_local)) ||
+      (NULL == CU_add_test(parsersuite, "Local choice",          &test_local_choice))) {
     CU_cleanup_registry();
     return CU_get_error();
   }
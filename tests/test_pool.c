@@ -0,0 +1,258 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zmq.h>
+
+#include "sc/pool.h"
+#include "sc/primitives.h"
+#include "sc/transport.h"
+#include "sc/types.h"
+#include "sc/utils.h"
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Console.h>
+
+#define WARMUP 1000
+#define ITERS  100000
+#define LARGE  (512 * 1024) // Integers (2MB), more than the largest slab size class.
+
+/*
+ * Allocation counting mode: libsc is linked with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+ * so every allocator call made by libsc is counted here.
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static volatile unsigned long nalloc = 0;
+
+void *__wrap_malloc(size_t size)
+{
+  __sync_fetch_and_add(&nalloc, 1);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+  __sync_fetch_and_add(&nalloc, 1);
+  return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+  __sync_fetch_and_add(&nalloc, 1);
+  return __real_realloc(ptr, size);
+}
+
+
+void *ctx;
+session s;
+struct role_endpoint ep_a, ep_b;
+role role_a, role_b;
+char *labels[] = { "Label" };
+unsigned int label_keys[1];
+int large_sbuf[LARGE], large_rbuf[LARGE];
+
+int setup_poolsuite(void)
+{
+  // Two roles of a hand-made session connected over inproc PAIR sockets.
+  memset(&s, 0, sizeof(session));
+  memset(&ep_a, 0, sizeof(struct role_endpoint));
+  memset(&ep_b, 0, sizeof(struct role_endpoint));
+  label_keys[0] = sc_label_hash(labels[0]);
+  s.nlabel = 1;
+  s.labels = labels;
+  s.label_keys = label_keys;
+
+  ep_a.tp = &transport_zmq;
+  ep_b.tp = &transport_zmq;
+
+  ctx = zmq_init(1);
+  ep_a.ptr = zmq_socket(ctx, ZMQ_PAIR);
+  ep_b.ptr = zmq_socket(ctx, ZMQ_PAIR);
+  if (zmq_bind(ep_a.ptr, "inproc://test_pool") != 0) return -1;
+  if (zmq_connect(ep_b.ptr, "inproc://test_pool") != 0) return -1;
+
+  role_a.s = &s;
+  role_a.type = SESSION_ROLE_P2P;
+  role_a.p2p = &ep_a;
+  role_b.s = &s;
+  role_b.type = SESSION_ROLE_P2P;
+  role_b.p2p = &ep_b;
+
+  return 0;
+}
+
+
+int teardown_poolsuite(void)
+{
+  zmq_close(ep_a.ptr);
+  zmq_close(ep_b.ptr);
+  zmq_term(ctx);
+  return 0;
+}
+
+
+void test_size_classes(void)
+{
+  void *buf;
+
+  buf = sc_pool_alloc(1);
+  CU_ASSERT(64 == sc_pool_size(buf));
+  sc_pool_free(buf);
+
+  buf = sc_pool_alloc(65);
+  CU_ASSERT(128 == sc_pool_size(buf));
+  buf = sc_pool_realloc(buf, 1000);
+  CU_ASSERT(1024 == sc_pool_size(buf));
+  sc_pool_free(buf);
+
+  buf = sc_pool_alloc(3 * 1024 * 1024); // Large size class.
+  CU_ASSERT(NULL != buf);
+  CU_ASSERT(4 * 1024 * 1024 == sc_pool_size(buf));
+  memset(buf, 0, 4 * 1024 * 1024);
+  sc_pool_free(buf);
+}
+
+
+void test_steady_state(void)
+{
+  void *bufs[16];
+  pool_stat before, after;
+  int i, j;
+
+  for (i=0; i<WARMUP; ++i) {
+    for (j=0; j<16; ++j) bufs[j] = sc_pool_alloc(j * 4096 + 1);
+    for (j=0; j<16; ++j) sc_pool_free(bufs[j]);
+  }
+
+  sc_pool_stats(&before);
+  for (i=0; i<ITERS; ++i) {
+    for (j=0; j<16; ++j) bufs[j] = sc_pool_alloc(j * 4096 + 1);
+    for (j=0; j<16; ++j) sc_pool_free(bufs[j]);
+  }
+  sc_pool_stats(&after);
+
+  CU_ASSERT(before.slabs == after.slabs);
+  CU_ASSERT(before.large == after.large);
+}
+
+
+void *free_bufs(void *arg)
+{
+  void **bufs = (void **)arg;
+  int i;
+  for (i=0; i<256; ++i) sc_pool_free(bufs[i]);
+  return NULL;
+}
+
+
+void test_cross_thread_free(void)
+{
+  void *bufs[256];
+  pool_stat before, after;
+  pthread_t thread;
+  int i, j;
+
+  for (i=0; i<1000; ++i) {
+    if (i == 100) sc_pool_stats(&before);
+    for (j=0; j<256; ++j) bufs[j] = sc_pool_alloc(256);
+    pthread_create(&thread, NULL, free_bufs, bufs);
+    pthread_join(thread, NULL);
+  }
+  sc_pool_stats(&after);
+
+  // Buffers cached by exited threads are returned to the depot.
+  CU_ASSERT(before.slabs == after.slabs);
+}
+
+
+void sendrecv_loop(int iters)
+{
+  int sbuf[1024], rbuf[1024];
+  size_t count;
+  int label_id;
+  int i;
+
+  for (i=0; i<iters; ++i) {
+    sbuf[0] = i;
+    send_int_array(sbuf, 1024, &role_a, NULL);
+    count = 1024;
+    recv_int_array(rbuf, &count, &role_b);
+    CU_ASSERT(rbuf[0] == i && count == 1024);
+
+    send_int_array(sbuf, 16, &role_b, "Label");
+    count = 1024;
+    recv_int_array_labelled(&label_id, rbuf, &count, &role_a);
+    CU_ASSERT(label_id == 0 && count == 16);
+
+    if (i % 100 == 0) { // Large messages, every so often.
+      large_sbuf[0] = i;
+      send_int_array(large_sbuf, LARGE, &role_a, NULL);
+      count = LARGE;
+      recv_int_array(large_rbuf, &count, &role_b);
+      CU_ASSERT(large_rbuf[0] == i && count == LARGE);
+    }
+  }
+}
+
+
+void test_sendrecv_no_alloc(void)
+{
+  unsigned long n;
+  pool_stat before, after;
+
+  sendrecv_loop(WARMUP);
+  n = nalloc;
+  sc_pool_stats(&before);
+  sendrecv_loop(ITERS / 10);
+  sc_pool_stats(&after);
+  CU_ASSERT(n == nalloc);
+  CU_ASSERT(before.large == after.large); // Mapped once, then reused.
+}
+
+
+void test_sendrecv_coalesce_no_alloc(void)
+{
+  unsigned long n;
+
+  s.coalesce = 1;
+  sendrecv_loop(WARMUP);
+  n = nalloc;
+  sendrecv_loop(ITERS / 10);
+  CU_ASSERT(n == nalloc);
+  s.coalesce = 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+  CU_pSuite poolsuite = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  poolsuite = CU_add_suite("Session C buffer pool", setup_poolsuite, teardown_poolsuite);
+
+  if (NULL == poolsuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ((NULL == CU_add_test(poolsuite, "Size classes",                   &test_size_classes)) ||
+      (NULL == CU_add_test(poolsuite, "Steady state",                   &test_steady_state)) ||
+      (NULL == CU_add_test(poolsuite, "Cross-thread free",              &test_cross_thread_free)) ||
+      (NULL == CU_add_test(poolsuite, "Send/recv without allocation",   &test_sendrecv_no_alloc)) ||
+      (NULL == CU_add_test(poolsuite, "Coalesced send/recv without allocation", &test_sendrecv_coalesce_no_alloc))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  CU_console_run_tests();
+  CU_cleanup_registry();
+
+  return CU_get_error();
+}
@@ -0,0 +1,244 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <zmq.h>
+
+#include "sc/primitives.h"
+#include "sc/request.h"
+#include "sc/ring.h"
+#include "sc/transport.h"
+#include "sc/types.h"
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Console.h>
+
+#define EXCHANGE (1024 * 1024) // Integers, more than a ring.
+
+
+session s_a, s_b;
+struct role_endpoint ep_a, ep_b;
+role role_a, role_b;
+role *roles_a[] = { &role_a }, *roles_b[] = { &role_b };
+
+
+/**
+ * Role a (server) of a hand-made session connected over shm: on port.
+ */
+int setup_server(unsigned port)
+{
+  memset(&s_a, 0, sizeof(session));
+  memset(&ep_a, 0, sizeof(struct role_endpoint));
+  ep_a.tp = &transport_shm;
+  role_a.s = &s_a;
+  role_a.type = SESSION_ROLE_P2P;
+  role_a.p2p = &ep_a;
+  s_a.nrole = 1;
+  s_a.roles = roles_a;
+  return transport_shm.connect(&ep_a, &s_a, "localhost", port, 1);
+}
+
+
+/**
+ * Role b (client), used by a peer thread.
+ */
+int setup_client(unsigned port)
+{
+  memset(&s_b, 0, sizeof(session));
+  memset(&ep_b, 0, sizeof(struct role_endpoint));
+  ep_b.tp = &transport_shm;
+  role_b.s = &s_b;
+  role_b.type = SESSION_ROLE_P2P;
+  role_b.p2p = &ep_b;
+  s_b.nrole = 1;
+  s_b.roles = roles_b;
+  return transport_shm.connect(&ep_b, &s_b, "localhost", port, 0);
+}
+
+
+void teardown(void)
+{
+  transport_shm.close(&ep_a);
+  transport_shm.close(&ep_b);
+}
+
+
+void *exchange(void *arg)
+{
+  int *sbuf = (int *)malloc(sizeof(int) * EXCHANGE);
+  int *rbuf = (int *)malloc(sizeof(int) * EXCHANGE);
+  size_t count = EXCHANGE;
+  int ok;
+
+  sbuf[0] = sbuf[EXCHANGE-1] = 2;
+  send_int_array(sbuf, EXCHANGE, &role_b, NULL);
+  recv_int_array(rbuf, &count, &role_b);
+  ok = (count == EXCHANGE && rbuf[0] == 1 && rbuf[EXCHANGE-1] == 1);
+  transport_shm.close(&ep_b); // Lingers until the rest of the send is in the ring.
+  free(sbuf);
+  free(rbuf);
+  return ok ? arg : NULL;
+}
+
+
+void test_exchange(void)
+{
+  int *sbuf = (int *)malloc(sizeof(int) * EXCHANGE);
+  int *rbuf = (int *)malloc(sizeof(int) * EXCHANGE);
+  size_t count = EXCHANGE;
+  pthread_t thread;
+  void *ok;
+
+  CU_ASSERT(0 == setup_server(7790));
+  CU_ASSERT(0 == setup_client(7790));
+
+  // Both roles send first, neither send may wait for the other's receive.
+  pthread_create(&thread, NULL, exchange, sbuf);
+  sbuf[0] = sbuf[EXCHANGE-1] = 1;
+  CU_ASSERT(0 == send_int_array(sbuf, EXCHANGE, &role_a, NULL));
+  CU_ASSERT(0 == recv_int_array(rbuf, &count, &role_a));
+  CU_ASSERT(count == EXCHANGE && rbuf[0] == 2 && rbuf[EXCHANGE-1] == 2);
+  transport_shm.close(&ep_a);
+
+  pthread_join(thread, &ok);
+  CU_ASSERT(ok == sbuf);
+  free(sbuf);
+  free(rbuf);
+}
+
+
+void *sink(void *arg)
+{
+  int *buf = (int *)malloc(sizeof(int) * EXCHANGE);
+  size_t count;
+  int i, ok = 1;
+
+  for (i=0; i<2; ++i) {
+    count = EXCHANGE;
+    recv_int_array(buf, &count, &role_b);
+    ok &= (count == EXCHANGE && buf[0] == i && buf[EXCHANGE-1] == i);
+  }
+  free(buf);
+  return ok ? arg : NULL;
+}
+
+
+void test_isend_wait(void)
+{
+  int *buf = (int *)malloc(sizeof(int) * EXCHANGE);
+  request *req;
+  pthread_t thread;
+  void *ok;
+  int i;
+
+  CU_ASSERT(0 == setup_server(7791));
+  CU_ASSERT(0 == setup_client(7791));
+  pthread_create(&thread, NULL, sink, buf);
+
+  // Completes once the last piece is in the ring.
+  for (i=0; i<2; ++i) {
+    buf[0] = buf[EXCHANGE-1] = i;
+    CU_ASSERT(0 == isend_int_array(buf, EXCHANGE, &role_a, NULL, &req));
+    CU_ASSERT(0 == request_wait(&req));
+  }
+
+  pthread_join(thread, &ok);
+  CU_ASSERT(ok == buf);
+  teardown();
+  free(buf);
+}
+
+
+void *send_close(void *arg)
+{
+  int *buf = (int *)arg;
+
+  buf[0] = buf[EXCHANGE-1] = 3;
+  send_int_array(buf, EXCHANGE, &role_a, NULL);
+  transport_shm.close(&ep_a); // Before the client attaches.
+  return NULL;
+}
+
+
+void test_close_first(void)
+{
+  int *sbuf = (int *)malloc(sizeof(int) * EXCHANGE);
+  int *rbuf = (int *)malloc(sizeof(int) * EXCHANGE);
+  size_t count = EXCHANGE;
+  pthread_t thread;
+
+  CU_ASSERT(0 == setup_server(7792));
+  pthread_create(&thread, NULL, send_close, sbuf);
+  usleep(100000);
+
+  CU_ASSERT(0 == setup_client(7792));
+  CU_ASSERT(0 == recv_int_array(rbuf, &count, &role_b));
+  CU_ASSERT(count == EXCHANGE && rbuf[0] == 3 && rbuf[EXCHANGE-1] == 3);
+
+  pthread_join(thread, NULL);
+  transport_shm.close(&ep_b);
+  free(sbuf);
+  free(rbuf);
+}
+
+
+void test_stale(void)
+{
+  int val = 4;
+  size_t count = 1;
+  char *stale;
+  int fd;
+
+  // Left by a crashed run: garbage ring indices.
+  fd = shm_open("/sessionc-ring-7793", O_CREAT | O_RDWR, 0600);
+  CU_ASSERT(fd >= 0);
+  CU_ASSERT(0 == ftruncate(fd, 4 * 1024 * 1024));
+  stale = (char *)mmap(NULL, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  memset(stale, 0x5a, 4096);
+  munmap(stale, 4096);
+  close(fd);
+
+  CU_ASSERT(0 == setup_server(7793));
+  CU_ASSERT(0 == setup_client(7793));
+  CU_ASSERT(0 == send_int_array(&val, 1, &role_a, NULL));
+  val = 0;
+  CU_ASSERT(0 == recv_int_array(&val, &count, &role_b));
+  CU_ASSERT(count == 1 && val == 4);
+  teardown();
+
+  // Attached segments are removed by name.
+  CU_ASSERT(shm_open("/sessionc-ring-7793", O_RDWR, 0600) < 0);
+}
+
+
+int main(int argc, char *argv[])
+{
+  CU_pSuite suite = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  suite = CU_add_suite("Session C shared memory ring", NULL, NULL);
+
+  if (NULL == suite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ((NULL == CU_add_test(suite, "Exchange",            &test_exchange)) ||
+      (NULL == CU_add_test(suite, "isend and wait",      &test_isend_wait)) ||
+      (NULL == CU_add_test(suite, "Close before attach", &test_close_first)) ||
+      (NULL == CU_add_test(suite, "Stale segment",       &test_stale))) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  CU_console_run_tests();
+  CU_cleanup_registry();
+
+  return CU_get_error();
+}
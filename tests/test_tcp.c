@@ -0,0 +1,296 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zmq.h>
+
+#include "sc/primitives.h"
+#include "sc/request.h"
+#include "sc/tcp.h"
+#include "sc/transport.h"
+#include "sc/types.h"
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Console.h>
+
+#define ITERS 10000
+#define LARGE (1024 * 1024) // Integers, more than a socket buffer.
+#define EXCHANGE (16 * 1024 * 1024) // Integers, more than the buffers of both ends.
+
+
+const transport *tp;
+session s_a, s_b;
+struct role_endpoint ep_a, ep_b;
+role role_a, role_b;
+role *roles_a[] = { &role_a }, *roles_b[] = { &role_b };
+
+
+/**
+ * Two roles of hand-made sessions connected over tp, role_a (the
+ * server) used by the test, role_b by a peer thread.
+ */
+int setup_conn(const transport *transport, unsigned port)
+{
+  tp = transport;
+  memset(&s_a, 0, sizeof(session));
+  memset(&s_b, 0, sizeof(session));
+  memset(&ep_a, 0, sizeof(struct role_endpoint));
+  memset(&ep_b, 0, sizeof(struct role_endpoint));
+
+  ep_a.tp = tp;
+  ep_b.tp = tp;
+  if (tp->connect(&ep_a, &s_a, "localhost", port, 1) != 0) return -1;
+  if (tp->connect(&ep_b, &s_b, "localhost", port, 0) != 0) return -1;
+
+  role_a.s = &s_a;
+  role_a.type = SESSION_ROLE_P2P;
+  role_a.p2p = &ep_a;
+  s_a.nrole = 1;
+  s_a.roles = roles_a;
+  role_b.s = &s_b;
+  role_b.type = SESSION_ROLE_P2P;
+  role_b.p2p = &ep_b;
+  s_b.nrole = 1;
+  s_b.roles = roles_b;
+
+  return 0;
+}
+
+
+int setup_tcpsuite(void)
+{
+  return setup_conn(&transport_tcp, 7780);
+}
+
+
+int setup_uringsuite(void)
+{
+  return setup_conn(&transport_uring, 7781);
+}
+
+
+int teardown_suite(void)
+{
+  if (ep_a.ptr != NULL) tp->close(&ep_a);
+  if (ep_b.ptr != NULL) tp->close(&ep_b);
+  return 0;
+}
+
+
+void test_select(void)
+{
+  const char *addr;
+
+  CU_ASSERT(&transport_tcp == transport_select("tcp:localhost", &addr));
+  CU_ASSERT(strcmp(addr, "localhost") == 0);
+  CU_ASSERT(&transport_uring == transport_select("uring:localhost", &addr));
+  CU_ASSERT(strcmp(addr, "localhost") == 0);
+}
+
+
+void *pong(void *arg)
+{
+  int buf[1024];
+  size_t count;
+  int i;
+
+  for (i=0; i<ITERS; ++i) {
+    count = 1024;
+    recv_int_array(buf, &count, &role_b);
+    send_int_array(buf, count, &role_b, NULL);
+  }
+  send_flush(&s_b); // The last reply may be held back.
+  return NULL;
+}
+
+
+void test_pingpong(void)
+{
+  int sbuf[1024], rbuf[1024];
+  size_t count;
+  pthread_t thread;
+  int i, ok = 1;
+
+  pthread_create(&thread, NULL, pong, NULL);
+  for (i=0; i<ITERS; ++i) {
+    sbuf[0] = i;
+    send_int_array(sbuf, (i % 1024) + 1, &role_a, NULL);
+    count = 1024;
+    recv_int_array(rbuf, &count, &role_a);
+    ok &= (rbuf[0] == i && count == (size_t)(i % 1024) + 1);
+  }
+  pthread_join(thread, NULL);
+  CU_ASSERT(ok);
+}
+
+
+void *sink(void *arg)
+{
+  int *buf = (int *)malloc(sizeof(int) * LARGE);
+  size_t count;
+  int i, ok = 1;
+
+  for (i=0; i<4; ++i) {
+    count = LARGE;
+    recv_int_array(buf, &count, &role_b);
+    ok &= (count == LARGE && buf[0] == i && buf[LARGE-1] == i);
+  }
+  free(buf);
+  return ok ? arg : NULL;
+}
+
+
+void test_isend_wait(void)
+{
+  int *buf = (int *)malloc(sizeof(int) * LARGE);
+  request *req;
+  pthread_t thread;
+  void *ok;
+  int i;
+
+  pthread_create(&thread, NULL, sink, buf);
+
+  // Non-blocking sends, waited for (the transport may hold them back).
+  for (i=0; i<2; ++i) {
+    buf[0] = buf[LARGE-1] = i;
+    CU_ASSERT(0 == isend_int_array(buf, LARGE, &role_a, NULL, &req));
+    CU_ASSERT(0 == request_wait(&req));
+  }
+
+  // Persistent send, restarted.
+  CU_ASSERT(0 == send_int_array_init(buf, LARGE, &role_a, NULL, &req));
+  for (i=2; i<4; ++i) {
+    buf[0] = buf[LARGE-1] = i;
+    CU_ASSERT(0 == request_start(req));
+    CU_ASSERT(0 == request_wait(&req));
+  }
+  request_free(&req);
+
+  pthread_join(thread, &ok);
+  CU_ASSERT(ok == buf);
+  free(buf);
+}
+
+
+void *mixed_sink(void *arg)
+{
+  int *big = (int *)malloc(sizeof(int) * EXCHANGE);
+  int small[2];
+  size_t nbig = EXCHANGE, nsmall = 2;
+  request *reqs[2];
+  int val = 0, ok;
+
+  // A blocking receive after non-blocking ones takes the message after theirs.
+  irecv_int_array(big, &nbig, &role_b, &reqs[0]);
+  irecv_int_array(small, &nsmall, &role_b, &reqs[1]);
+  recv_int(&val, &role_b);
+  ok = (request_waitall(2, reqs) == 0 && val == 2);
+  ok &= (nbig == EXCHANGE && big[0] == 0 && big[EXCHANGE-1] == 0);
+  ok &= (nsmall == 1 && small[0] == 1);
+  free(big);
+  return ok ? arg : NULL;
+}
+
+
+void test_mixed(void)
+{
+  int *big = (int *)malloc(sizeof(int) * EXCHANGE);
+  int small = 1;
+  request *reqs[2];
+  pthread_t thread;
+  void *ok;
+
+  pthread_create(&thread, NULL, mixed_sink, big);
+
+  // The second send is posted while the first is still going out,
+  // the blocking send after it must not overtake it.
+  big[0] = big[EXCHANGE-1] = 0;
+  CU_ASSERT(0 == isend_int_array(big, EXCHANGE, &role_a, NULL, &reqs[0]));
+  CU_ASSERT(0 == isend_int_array(&small, 1, &role_a, NULL, &reqs[1]));
+  CU_ASSERT(0 == send_int(2, &role_a, NULL));
+  CU_ASSERT(0 == request_waitall(2, reqs));
+
+  pthread_join(thread, &ok);
+  CU_ASSERT(ok == big);
+  free(big);
+}
+
+
+void *exchange(void *arg)
+{
+  int *sbuf = (int *)malloc(sizeof(int) * EXCHANGE);
+  int *rbuf = (int *)malloc(sizeof(int) * EXCHANGE);
+  size_t count = EXCHANGE;
+  int ok;
+
+  sbuf[0] = sbuf[EXCHANGE-1] = 2;
+  send_int_array(sbuf, EXCHANGE, &role_b, NULL);
+  recv_int_array(rbuf, &count, &role_b);
+  ok = (count == EXCHANGE && rbuf[0] == 1 && rbuf[EXCHANGE-1] == 1);
+  tp->close(&ep_b); // Lingers until the rest of the send is out.
+  free(sbuf);
+  free(rbuf);
+  return ok ? arg : NULL;
+}
+
+
+void test_exchange(void)
+{
+  int *sbuf = (int *)malloc(sizeof(int) * EXCHANGE);
+  int *rbuf = (int *)malloc(sizeof(int) * EXCHANGE);
+  size_t count = EXCHANGE;
+  pthread_t thread;
+  void *ok;
+
+  // Both roles send first, neither send may wait for the other's receive.
+  pthread_create(&thread, NULL, exchange, sbuf);
+  sbuf[0] = sbuf[EXCHANGE-1] = 1;
+  CU_ASSERT(0 == send_int_array(sbuf, EXCHANGE, &role_a, NULL));
+  CU_ASSERT(0 == recv_int_array(rbuf, &count, &role_a));
+  CU_ASSERT(count == EXCHANGE && rbuf[0] == 2 && rbuf[EXCHANGE-1] == 2);
+  tp->close(&ep_a);
+
+  pthread_join(thread, &ok);
+  CU_ASSERT(ok == sbuf);
+  free(sbuf);
+  free(rbuf);
+}
+
+
+int add_tests(CU_pSuite suite)
+{
+  return (NULL == CU_add_test(suite, "Transport selection", &test_select)) ||
+         (NULL == CU_add_test(suite, "Ping-pong",           &test_pingpong)) ||
+         (NULL == CU_add_test(suite, "isend and wait",      &test_isend_wait)) ||
+         (NULL == CU_add_test(suite, "isend and send",      &test_mixed)) ||
+         (NULL == CU_add_test(suite, "Exchange",            &test_exchange)); // Closes the endpoints.
+}
+
+
+int main(int argc, char *argv[])
+{
+  CU_pSuite tcpsuite = NULL;
+  CU_pSuite uringsuite = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  tcpsuite = CU_add_suite("Session C raw TCP", setup_tcpsuite, teardown_suite);
+  uringsuite = CU_add_suite("Session C io_uring", setup_uringsuite, teardown_suite);
+
+  if (NULL == tcpsuite || NULL == uringsuite) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if (add_tests(tcpsuite) || add_tests(uringsuite)) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  CU_console_run_tests();
+  CU_cleanup_registry();
+
+  return CU_get_error();
+}